@@ -1,50 +1,53 @@
 #include "Archetype.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 namespace ecs
 {
+	Archetype::Archetype(const allocator_type& aAllocator)
+		: myType(aAllocator), myColumnLookup(aAllocator), components(aAllocator), entities(aAllocator), myEnabledRows(aAllocator), myAddedTicks(aAllocator),
+		myChangedTicks(aAllocator), myNewestAddedTicks(aAllocator), myNewestChangedTicks(aAllocator), edges(aAllocator), myChunks(aAllocator), myColumnOffsets(aAllocator)
+	{
+	}
 	Archetype::Archetype(Archetype&& aArchetype) noexcept
+		: Archetype(std::move(aArchetype), aArchetype.get_allocator())
 	{
-		myID = aArchetype.myID;
-		myType = aArchetype.myType;
-		typeSet = std::move(aArchetype.typeSet);
-		components.resize(aArchetype.components.size());
-		//components = std::move(aArchetype.components);
-		for(int i = 0; i < components.size(); i++)
-		{
-			components[i] = std::move(aArchetype.components[i]);
-		}
-
-		entities = std::move(aArchetype.entities);
-		edges = std::move(aArchetype.edges);
-		myMaxCount = aArchetype.myMaxCount;
-
-
 	}
-	Archetype& Archetype::operator=(const Archetype& aArchetype)
+	Archetype::Archetype(Archetype&& aArchetype, const allocator_type& aAllocator)
+		: Archetype(aAllocator)
 	{
-		myID = aArchetype.myID;
-		myType = aArchetype.myType;
-		typeSet = aArchetype.typeSet;
-		components = aArchetype.components;
-		entities = aArchetype.entities;
-		edges = aArchetype.edges;
-		myMaxCount = aArchetype.myMaxCount;
-		return *this;
+		*this = std::move(aArchetype);
 	}
 	Archetype& Archetype::operator=(Archetype&& aArchetype)
 	{
+		//The counts stay with the world each side is registered in
+		ChangeEntityCount(-static_cast<ptrdiff_t>(entities.size()));
+		aArchetype.ChangeEntityCount(-static_cast<ptrdiff_t>(aArchetype.entities.size()));
 		myID = aArchetype.myID;
 		myType = aArchetype.myType;
-		typeSet = std::move(aArchetype.typeSet);
+		mySignature = aArchetype.mySignature;
+		myColumnLookup = aArchetype.myColumnLookup;
 		components.resize(aArchetype.components.size());
 		for(int i = 0; i < aArchetype.components.size(); i++)
 		{
 			components[i] = std::move(aArchetype.components[i]);
 		}
 		entities = std::move(aArchetype.entities);
+		myEnabledRows = std::move(aArchetype.myEnabledRows);
+		myAddedTicks = std::move(aArchetype.myAddedTicks);
+		myChangedTicks = std::move(aArchetype.myChangedTicks);
+		myNewestAddedTicks = std::move(aArchetype.myNewestAddedTicks);
+		myNewestChangedTicks = std::move(aArchetype.myNewestChangedTicks);
+		myLowEdges = aArchetype.myLowEdges;
 		edges = std::move(aArchetype.edges);
-		myMaxCount = aArchetype.myMaxCount;
+		TakeChunks(aArchetype);
+		ChangeEntityCount(static_cast<ptrdiff_t>(entities.size()));
 		return *this;
 	}
+	Archetype::allocator_type Archetype::get_allocator() const
+	{
+		return myChunks.get_allocator();
+	}
 	size_t Archetype::GetLastRow() const
 	{
 		return entities.size() - 1;
@@ -77,17 +80,185 @@ namespace ecs
 
 	size_t Archetype::GetMaxCount() const
 	{
-		return myMaxCount;
+		return myChunks.size() << myChunkShift;
 	}
 
 	void Archetype::SetType(const Type& aType)
 	{
 		myType = aType;
+		mySignature.reset();
+		for (ComponentID componentID : myType)
+		{
+			mySignature.set(componentID);
+		}
+		myNewestAddedTicks.assign(myType.size(), 0);
+		myNewestChangedTicks.assign(myType.size(), 0);
+
+		//Columns are laid out in type order with tags skipped, same as the column indices in the component index.
+		myColumnLookup.assign(myType.empty() ? 0 : myType.back() + 1, -1);
+		int columnIndex = 0;
+		for (ComponentID componentID : myType)
+		{
+			if (ComponentRegistry::GetTypeInfo(componentID).isTag) continue;
+			myColumnLookup[componentID] = columnIndex++;
+		}
+	}
+
+	size_t Archetype::GetChunkCapacity() const
+	{
+		return size_t(1) << myChunkShift;
+	}
+
+	size_t Archetype::GetNumChunks() const
+	{
+		return myChunks.size();
+	}
+
+	void Archetype::CalculateChunkLayout()
+	{
+		size_t rowSize = 0;
+		for (const auto& comp : components)
+		{
+			rowSize += comp.GetElementSize();
+		}
+
+		//Largest power of two amount of rows that still fits the chunk size, a row bigger than a chunk gets one row per chunk
+		myChunkShift = 0;
+		while (0 < rowSize && rowSize * (size_t(2) << myChunkShift) <= ECS_CHUNK_SIZE)
+		{
+			myChunkShift++;
+		}
+
+		//Every slice starts on a cache line or on the alignment of its type if that is stricter, since the element size
+		//is always a multiple of the type alignment every element in the slice ends up aligned as well.
+		myColumnOffsets.clear();
+		myChunkBytes = 0;
+		myChunkAlignment = ECS_COLUMN_ALIGNMENT;
+		for (const auto& comp : components)
+		{
+			const size_t alignment = std::max(ECS_COLUMN_ALIGNMENT, comp.GetTypeInfo().alignment);
+			assert((alignment & (alignment - 1)) == 0, "Component alignment has to be a power of two");
+			myChunkAlignment = std::max(myChunkAlignment, alignment);
+			myChunkBytes = (myChunkBytes + alignment - 1) & ~(alignment - 1);
+			myColumnOffsets.push_back(myChunkBytes);
+			myChunkBytes += comp.GetElementSize() << myChunkShift;
+		}
+	}
+
+	void Archetype::AddChunk()
+	{
+		if (myChunks.empty())
+		{
+			CalculateChunkLayout();
+		}
+
+		//Archetypes with only tags have no column data, the entity list is all they need.
+		if (myChunkBytes == 0)
+		{
+			myChunks.emplace_back();
+			return;
+		}
+
+		std::pmr::memory_resource* resource = get_allocator().resource();
+		std::byte* chunk = static_cast<std::byte*>(resource->allocate(myChunkBytes, myChunkAlignment));
+		myChunks.emplace_back(chunk, ChunkDeleter{ resource, myChunkBytes, myChunkAlignment });
+		for (size_t i = 0; i < components.size(); i++)
+		{
+			components[i].SetChunkShift(myChunkShift);
+			components[i].AddChunk(chunk + myColumnOffsets[i]);
+		}
+	}
+
+	//Allocates every chunk needed to hold aRows rows up front, rows added later until then never allocate.
+	void Archetype::ReserveRows(size_t aRows)
+	{
+		entities.reserve(aRows);
+		myAddedTicks.reserve(aRows * myType.size());
+		myChangedTicks.reserve(aRows * myType.size());
+		while (GetMaxCount() < aRows)
+		{
+			AddChunk();
+		}
+	}
+
+	size_t Archetype::GetChunkMemory() const
+	{
+		return myChunkBytes * myChunks.size();
+	}
+
+	//Frees the chunks at the end that hold no rows, rows are always packed at the front so nothing has to move.
+	size_t Archetype::ReleaseUnusedChunks(size_t aMinChunks)
+	{
+		const size_t usedChunks = std::max((entities.size() + GetChunkCapacity() - 1) >> myChunkShift, aMinChunks);
+		size_t releasedBytes = 0;
+		while (usedChunks < myChunks.size())
+		{
+			myChunks.pop_back();
+			for (auto& comp : components)
+			{
+				comp.PopChunk();
+			}
+			releasedBytes += myChunkBytes;
+		}
+		return releasedBytes;
 	}
 
-	void Archetype::SetMaxCount(size_t aMaxCount)
+	size_t Archetype::UpdateMemoryReclaim(const MemoryReclaimPolicy& aPolicy)
 	{
-		myMaxCount = aMaxCount;
+		if (myChunks.size() <= aPolicy.minChunks || aPolicy.occupancyThreshold * GetMaxCount() <= entities.size())
+		{
+			myFramesUnderOccupied = 0;
+			return 0;
+		}
+
+		if (++myFramesUnderOccupied < aPolicy.frameCount)
+		{
+			return 0;
+		}
+
+		myFramesUnderOccupied = 0;
+		return ReleaseUnusedChunks(aPolicy.minChunks);
+	}
+
+	void Archetype::TakeChunks(Archetype& aArchetype)
+	{
+		myColumnOffsets = aArchetype.myColumnOffsets;
+		myChunkShift = aArchetype.myChunkShift;
+		myChunkBytes = aArchetype.myChunkBytes;
+		myChunkAlignment = aArchetype.myChunkAlignment;
+		if (get_allocator() == aArchetype.get_allocator())
+		{
+			myChunks = std::move(aArchetype.myChunks);
+			return;
+		}
+
+		//The source lives in another memory resource, a stage being merged for example. The rows are moved into chunks of our own
+		//so that resource can be released without leaving our columns pointing into it.
+		std::pmr::vector<ChunkPtr> sourceChunks = std::move(aArchetype.myChunks);
+		myChunks.clear();
+		for (auto& comp : components)
+		{
+			comp.ClearChunks();
+		}
+		for (size_t i = 0; i < sourceChunks.size(); i++)
+		{
+			AddChunk();
+		}
+
+		//The moved from values are destructed before sourceChunks releases their memory at the end of the scope
+		const size_t rowMask = GetChunkCapacity() - 1;
+		for (size_t i = 0; i < components.size(); i++)
+		{
+			Column& column = components[i];
+			const ComponentTypeInfo& typeInfo = column.GetTypeInfo();
+			const bool needsDestruct = !typeInfo.isTrivial && typeInfo.destruct;
+			for (size_t row = 0; row < entities.size(); row++)
+			{
+				std::byte* source = sourceChunks[row >> myChunkShift].get() + myColumnOffsets[i] + (row & rowMask) * column.GetElementSize();
+				column.MoveOrCopyDataFromTo(source, column.GetComponent(row));
+				if (needsDestruct) typeInfo.destruct(source);
+			}
+		}
 	}
 
 	Column* Archetype::GetColumn(size_t aColumnIndex)
@@ -105,14 +276,14 @@ namespace ecs
 		return entities.at(aRow);
 	}
 
-	void Archetype::AddComponentIDToTypeSet(ComponentID aComponentID)
+	const ComponentMask& Archetype::GetSignature() const
 	{
-		typeSet.insert(aComponentID);
+		return mySignature;
 	}
 
 	bool Archetype::HasComponent(ComponentID aComponentID) const
 	{
-		return typeSet.contains(aComponentID);
+		return mySignature.test(aComponentID);
 	}
 
 	size_t Archetype::GetNumEntities() const
@@ -138,25 +309,33 @@ namespace ecs
 	void Archetype::Reset()
 	{
 		int myPreviousCount = (int)entities.size();
+		ChangeEntityCount(-myPreviousCount);
 		entities.clear();
-		myMaxCount = 2;
+		myEnabledRows.clear();
+		myAddedTicks.clear();
+		myChangedTicks.clear();
+		myChunks.clear();
 		for (auto& comp : components)
 		{
-			comp.SetCapacity(myMaxCount * comp.GetElementSize());
-			comp.Reset(nullptr);
-			comp.Reset(new std::byte[comp.GetCapacity()]);
-
+			comp.ClearChunks();
 			comp.ChangeMemoryUsed(-myPreviousCount);
 		}
 	}
 
 	void Archetype::Reset(Archetype& aArchetype)
 	{
+		ChangeEntityCount(-static_cast<ptrdiff_t>(entities.size()));
+		aArchetype.ChangeEntityCount(-static_cast<ptrdiff_t>(aArchetype.entities.size()));
 		components.clear();
 		components = std::move(aArchetype.components);
-		myMaxCount = aArchetype.GetMaxCount();
 		entities = std::move(aArchetype.GetEntityList());
-		
+		myEnabledRows = std::move(aArchetype.myEnabledRows);
+		myAddedTicks = std::move(aArchetype.myAddedTicks);
+		myChangedTicks = std::move(aArchetype.myChangedTicks);
+		myNewestAddedTicks = std::move(aArchetype.myNewestAddedTicks);
+		myNewestChangedTicks = std::move(aArchetype.myNewestChangedTicks);
+		TakeChunks(aArchetype);
+		ChangeEntityCount(static_cast<ptrdiff_t>(entities.size()));
 	}
 
 	void Archetype::AddEmptyComp()
@@ -166,7 +345,7 @@ namespace ecs
 
 
 
-	std::vector<EntityID>& Archetype::GetEntityList()
+	std::pmr::vector<EntityID>& Archetype::GetEntityList()
 	{
 		return entities;
 	}
@@ -175,40 +354,224 @@ namespace ecs
 	{
 
 		entities.emplace_back(aEntity);
+		ChangeEntityCount(1);
+
+		//New rows start out untouched, whoever fills the row stamps the ticks
+		const size_t row = entities.size() - 1;
+		const size_t numTypes = myType.size();
+		myAddedTicks.resize(entities.size() * numTypes);
+		myChangedTicks.resize(entities.size() * numTypes);
+		std::fill_n(myAddedTicks.begin() + row * numTypes, numTypes, 0);
+		std::fill_n(myChangedTicks.begin() + row * numTypes, numTypes, 0);
+		if (myEnabledRows.empty()) return;
+
+		//New rows start with every component enabled
+		const size_t first = (row >> 6) * numTypes;
+		if (myEnabledRows.size() <= first)
+		{
+			myEnabledRows.resize(first + numTypes, ~uint64_t(0));
+			return;
+		}
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			myEnabledRows[first + slot] |= uint64_t(1) << (row & 63);
+		}
 	}
 
 
 
 
 
-	bool Archetype::Contains(const Type& type) const
+	bool Archetype::Contains(const ComponentMask& aMask) const
 	{
-		for (auto& t : type)
-		{
-			if (HasComponent(t) == false) return false;
-		}
-		return true;
+		return (mySignature & aMask) == aMask;
 	}
 
 	ArchetypeEdge& Archetype::AddEdge(ComponentID aComponentID)
 	{
-		return edges[aComponentID];
+		return GetOrAddEdge(aComponentID);
 	}
 
 	int Archetype::FindColumnIndex(ComponentID aComponentID) const
 	{
-		for (int i = 0; i < myType.size(); i++)
+		return aComponentID < myColumnLookup.size() ? myColumnLookup[aComponentID] : -1;
+	}
+
+	int Archetype::FindTypeIndex(ComponentID aComponentID) const
+	{
+		auto it = std::lower_bound(myType.begin(), myType.end(), aComponentID);
+		if (it == myType.end() || *it != aComponentID) return -1;
+		return static_cast<int>(it - myType.begin());
+	}
+
+	void Archetype::SetComponentEnabled(ComponentID aComponentID, size_t aRow, bool aEnabled)
+	{
+		const int slot = FindTypeIndex(aComponentID);
+		assert(slot >= 0 && aRow < entities.size(), "Entity doesn't have the component");
+		if (myEnabledRows.empty())
+		{
+			if (aEnabled) return;
+			myEnabledRows.resize(((entities.size() + 63) >> 6) * myType.size(), ~uint64_t(0));
+		}
+
+		uint64_t& word = myEnabledRows[(aRow >> 6) * myType.size() + slot];
+		const uint64_t bit = uint64_t(1) << (aRow & 63);
+		word = aEnabled ? word | bit : word & ~bit;
+	}
+
+	bool Archetype::IsComponentEnabled(ComponentID aComponentID, size_t aRow) const
+	{
+		const int slot = FindTypeIndex(aComponentID);
+		if (slot < 0) return false;
+		if (myEnabledRows.empty()) return true;
+		return (myEnabledRows[(aRow >> 6) * myType.size() + slot] >> (aRow & 63)) & 1;
+	}
+
+	bool Archetype::HasDisabledComponents() const
+	{
+		return !myEnabledRows.empty();
+	}
+
+	//Rows in block aBlock where every component in aComponents is enabled, bit i is row aBlock * 64 + i.
+	uint64_t Archetype::GetEnabledRows(const ComponentMask& aComponents, size_t aBlock) const
+	{
+		if (myEnabledRows.empty()) return ~uint64_t(0);
+
+		uint64_t rows = ~uint64_t(0);
+		const size_t numTypes = myType.size();
+		const uint64_t* block = myEnabledRows.data() + aBlock * numTypes;
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			if (aComponents.test(myType[slot])) rows &= block[slot];
+		}
+		return rows;
+	}
+
+	void Archetype::CopyEnabledState(const Archetype& aSource, size_t aSourceRow, size_t aRow)
+	{
+		if (aSource.myEnabledRows.empty()) return;
+
+		const size_t numTypes = aSource.myType.size();
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			if ((aSource.myEnabledRows[(aSourceRow >> 6) * numTypes + slot] >> (aSourceRow & 63)) & 1) continue;
+			if (HasComponent(aSource.myType[slot]))
+			{
+				SetComponentEnabled(aSource.myType[slot], aRow, false);
+			}
+		}
+	}
+
+	//Stamps a write to the component in aSlot. The newest tick goes through an atomic so ParallelEach can stamp rows
+	//of one archetype from several threads, each row is only ever written by the thread that owns it.
+	void Archetype::SetChangedTick(size_t aSlot, size_t aRow, ChangeTick aTick)
+	{
+		myChangedTicks[aRow * myType.size() + aSlot] = aTick;
+		std::atomic_ref<ChangeTick> newest(myNewestChangedTicks[aSlot]);
+		if (newest.load(std::memory_order_relaxed) < aTick)
+		{
+			newest.store(aTick, std::memory_order_relaxed);
+		}
+	}
+
+	//Lowers the change ticks of aComponents in the row that are newer than aTick to aTick.
+	//The newest ticks are left alone, they only have to be at least as new as every row.
+	void Archetype::ClampChangedTicks(const ComponentMask& aComponents, size_t aRow, ChangeTick aTick)
+	{
+		const size_t numTypes = myType.size();
+		ChangeTick* changed = myChangedTicks.data() + aRow * numTypes;
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			if (aComponents.test(myType[slot]) && changed[slot] > aTick) changed[slot] = aTick;
+		}
+	}
+
+	//Marks every component of rows [aFirstRow, aLastRow) as added, and so changed, at aTick.
+	void Archetype::SetRowsAdded(size_t aFirstRow, size_t aLastRow, ChangeTick aTick)
+	{
+		if (aFirstRow >= aLastRow) return;
+
+		const size_t numTypes = myType.size();
+		std::fill(myAddedTicks.begin() + aFirstRow * numTypes, myAddedTicks.begin() + aLastRow * numTypes, aTick);
+		std::fill(myChangedTicks.begin() + aFirstRow * numTypes, myChangedTicks.begin() + aLastRow * numTypes, aTick);
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			myNewestAddedTicks[slot] = std::max(myNewestAddedTicks[slot], aTick);
+			myNewestChangedTicks[slot] = std::max(myNewestChangedTicks[slot], aTick);
+		}
+	}
+
+	//Carries the ticks of the components the entity already had over from its old archetype, the ones it didn't have are added at aTick.
+	void Archetype::CopyChangeTicks(const Archetype& aSource, size_t aSourceRow, size_t aRow, ChangeTick aTick)
+	{
+		const size_t numTypes = myType.size();
+		for (size_t slot = 0; slot < numTypes; slot++)
+		{
+			const int sourceSlot = aSource.FindTypeIndex(myType[slot]);
+			const size_t index = aRow * numTypes + slot;
+			if (sourceSlot < 0)
+			{
+				myAddedTicks[index] = aTick;
+				myChangedTicks[index] = aTick;
+			}
+			else
+			{
+				const size_t sourceIndex = aSourceRow * aSource.myType.size() + sourceSlot;
+				myAddedTicks[index] = aSource.myAddedTicks[sourceIndex];
+				myChangedTicks[index] = aSource.myChangedTicks[sourceIndex];
+			}
+			myNewestAddedTicks[slot] = std::max(myNewestAddedTicks[slot], myAddedTicks[index]);
+			myNewestChangedTicks[slot] = std::max(myNewestChangedTicks[slot], myChangedTicks[index]);
+		}
+	}
+
+	//False when no row can pass the change filters, every component in aChanged has to be written and every one in aAdded added after aTick.
+	bool Archetype::HasChangesSince(const ComponentMask& aChanged, const ComponentMask& aAdded, ChangeTick aTick) const
+	{
+		for (size_t slot = 0; slot < myType.size(); slot++)
+		{
+			if (aChanged.test(myType[slot]) && myNewestChangedTicks[slot] <= aTick) return false;
+			if (aAdded.test(myType[slot]) && myNewestAddedTicks[slot] <= aTick) return false;
+		}
+		return true;
+	}
+
+	bool Archetype::IsRowChangedSince(const ComponentMask& aChanged, const ComponentMask& aAdded, size_t aRow, ChangeTick aTick) const
+	{
+		const size_t numTypes = myType.size();
+		const ChangeTick* added = myAddedTicks.data() + aRow * numTypes;
+		const ChangeTick* changed = myChangedTicks.data() + aRow * numTypes;
+		for (size_t slot = 0; slot < numTypes; slot++)
 		{
-			if (aComponentID != myType[i]) continue;
-			
-			return i;
+			if (aChanged.test(myType[slot]) && changed[slot] <= aTick) return false;
+			if (aAdded.test(myType[slot]) && added[slot] <= aTick) return false;
 		}
+		return true;
+	}
 
-		return -1;
+	void* Archetype::GetComponent(ComponentID aComponentID, size_t aRow)
+	{
+		const int columnIndex = FindColumnIndex(aComponentID);
+		if (columnIndex < 0) return nullptr;
+		return components[columnIndex].GetComponent(aRow);
 	}
 
 	void Archetype::ShuffleEntity(size_t aFromRow, size_t aToRow)
 	{
+		const size_t numTypes = myType.size();
+		std::copy_n(myAddedTicks.begin() + aFromRow * numTypes, numTypes, myAddedTicks.begin() + aToRow * numTypes);
+		std::copy_n(myChangedTicks.begin() + aFromRow * numTypes, numTypes, myChangedTicks.begin() + aToRow * numTypes);
+
+		if (!myEnabledRows.empty())
+		{
+			for (size_t slot = 0; slot < numTypes; slot++)
+			{
+				const bool enabled = (myEnabledRows[(aFromRow >> 6) * numTypes + slot] >> (aFromRow & 63)) & 1;
+				uint64_t& word = myEnabledRows[(aToRow >> 6) * numTypes + slot];
+				word = (word & ~(uint64_t(1) << (aToRow & 63))) | (uint64_t(enabled) << (aToRow & 63));
+			}
+		}
+
 		for (size_t i = 0; i < GetNumComponents(); i++)
 		{
 			auto& typeData = GetColumn(i)->GetTypeInfo();
@@ -228,16 +591,125 @@ namespace ecs
 		}
 	}
 
-	
+
+	//Destroys the rows in aRows, which has to be sorted and unique, and fills the holes they leave with the last rows in one pass.
+	//The entity list is compacted the same way so entities[row] tells which entity ended up in each hole.
+	void Archetype::RemoveRows(std::span<const size_t> aRows)
+	{
+		const size_t numRows = entities.size();
+		const size_t newSize = numRows - aRows.size();
+		ChangeEntityCount(-static_cast<ptrdiff_t>(aRows.size()));
+
+		for (size_t i = 0; i < GetNumComponents(); i++)
+		{
+			Column* column = GetColumn(i);
+			const ComponentTypeInfo& typeData = column->GetTypeInfo();
+			if (!typeData.isTrivial && typeData.destruct)
+			{
+				for (size_t row : aRows)
+				{
+					typeData.destruct(column->GetComponent(row));
+				}
+			}
+			column->ChangeMemoryUsed(-static_cast<int>(aRows.size()));
+		}
+
+		if (newSize == 0)
+		{
+			entities.clear();
+			myEnabledRows.clear();
+			myAddedTicks.clear();
+			myChangedTicks.clear();
+			return;
+		}
+
+		size_t from = numRows;
+		size_t victim = aRows.size();
+		for (size_t hole : aRows)
+		{
+			if (hole >= newSize) break;
+
+			//Last row that survives, rows past the new end that are removed as well are skipped
+			from--;
+			while (aRows[victim - 1] == from)
+			{
+				victim--;
+				from--;
+			}
+
+			ShuffleEntity(from, hole);
+			for (size_t i = 0; i < GetNumComponents(); i++)
+			{
+				Column* column = GetColumn(i);
+				const ComponentTypeInfo& typeData = column->GetTypeInfo();
+				if (!typeData.isTrivial && typeData.destruct)
+				{
+					typeData.destruct(column->GetComponent(from));
+				}
+			}
+			entities[hole] = entities[from];
+		}
+		entities.resize(newSize);
+		myAddedTicks.resize(newSize * myType.size());
+		myChangedTicks.resize(newSize * myType.size());
+	}
+
+	//Drops the last row from the entity list, the caller has already moved or destroyed its components
+	void Archetype::RemoveLastEntity()
+	{
+		entities.pop_back();
+		ChangeEntityCount(-1);
+	}
+
+	//Points the archetype at the entity counts of the world it is registered in, its rows move from the old counts to the new ones
+	void Archetype::SetEntityCounts(size_t* aEntityCounts)
+	{
+		ChangeEntityCount(-static_cast<ptrdiff_t>(entities.size()));
+		myEntityCounts = aEntityCounts;
+		ChangeEntityCount(static_cast<ptrdiff_t>(entities.size()));
+	}
+
+	void Archetype::ChangeEntityCount(ptrdiff_t aDelta)
+	{
+		if (!myEntityCounts || aDelta == 0) return;
+
+		for (ComponentID componentID : myType)
+		{
+			myEntityCounts[componentID] += aDelta;
+		}
+	}
 
 	ArchetypeEdge& Archetype::GetEdge(ComponentID aID)
 	{
-		return edges.at(aID);
+		ArchetypeEdge* edge = FindEdge(aID);
+		assert(edge, "Edge has not been added to archetype");
+		return *edge;
 	}
 
 	ArchetypeEdge& Archetype::GetOrAddEdge(ComponentID aID)
 	{
-		return edges[aID];
+		if (aID < ECS_LOW_EDGE_COUNT) return myLowEdges[aID];
+
+		const size_t index = aID - ECS_LOW_EDGE_COUNT;
+		if (edges.size() <= index)
+		{
+			edges.resize(index + 1);
+		}
+		return edges[index];
+	}
+
+	ArchetypeEdge* Archetype::FindEdge(ComponentID aID)
+	{
+		if (aID < ECS_LOW_EDGE_COUNT) return &myLowEdges[aID];
+
+		const size_t index = aID - ECS_LOW_EDGE_COUNT;
+		return index < edges.size() ? &edges[index] : nullptr;
+	}
+
+	void Archetype::ClearEdges()
+	{
+		myLowEdges.fill(ArchetypeEdge());
+		edges.clear();
 	}
 
 	size_t Archetype::GetNumComponents() const
@@ -247,6 +719,23 @@ namespace ecs
 
 
 
+	Column::Column(const allocator_type& aAllocator)
+		: myChunks(aAllocator)
+	{
+	}
+
+	Column::Column(const Column& aColumn, const allocator_type& aAllocator)
+		: myChunks(aColumn.myChunks, aAllocator), myTypeInfo(aColumn.myTypeInfo), myChunkShift(aColumn.myChunkShift),
+		myCurrentMemoryUsed(aColumn.myCurrentMemoryUsed)
+	{
+	}
+
+	Column::Column(Column&& aColumn, const allocator_type& aAllocator)
+		: myChunks(std::move(aColumn.myChunks), aAllocator), myTypeInfo(std::move(aColumn.myTypeInfo)), myChunkShift(aColumn.myChunkShift),
+		myCurrentMemoryUsed(aColumn.myCurrentMemoryUsed)
+	{
+	}
+
 	size_t ecs::Column::GetElementSize() const
 	{
 		return  myTypeInfo.size;
@@ -259,40 +748,42 @@ namespace ecs
 
 	size_t ecs::Column::GetCapacity() const
 	{
-		return myCapacity;
+		return (myChunks.size() << myChunkShift) * GetElementSize();
 	}
 
-	void ecs::Column::SetCapacity(size_t aCapacity)
+	size_t ecs::Column::GetChunkCapacity() const
 	{
-		myCapacity = aCapacity;
+		return size_t(1) << myChunkShift;
 	}
 
-	void ecs::Column::Reset(std::byte* aBuffer)
+	size_t ecs::Column::GetNumChunks() const
 	{
+		return myChunks.size();
+	}
 
-		myBuffer.reset(aBuffer);
+	void ecs::Column::SetChunkShift(size_t aChunkShift)
+	{
+		myChunkShift = aChunkShift;
 	}
 
-	void ecs::Column::Resize(size_t aNewSize)
+	void ecs::Column::AddChunk(std::byte* aChunk)
 	{
-		std::unique_ptr<std::byte[]> newData(new std::byte[aNewSize]);
-		if (myTypeInfo.isTrivial)
-		{
-			std::memcpy(newData.get(), myBuffer.get(), GetCapacity());
-		}
-		else
-		{
-			for (size_t index = 0; index < myCapacity / myTypeInfo.size; index++)
-			{
-				void* sourceComp = GetComponent(index);
-				void* targetComp = newData.get() + (index * GetElementSize());
-				MoveOrCopyDataFromTo(sourceComp, targetComp);
+		myChunks.push_back(aChunk);
+	}
 
-			}
-		}
+	void ecs::Column::PopChunk()
+	{
+		myChunks.pop_back();
+	}
 
-		SetCapacity(aNewSize);
-		myBuffer = std::move(newData);
+	void ecs::Column::ClearChunks()
+	{
+		myChunks.clear();
+	}
+
+	std::byte* ecs::Column::GetChunk(size_t aChunkIndex) const
+	{
+		return myChunks[aChunkIndex];
 	}
 
 	void ecs::Column::AssignTypeInfo(const ComponentTypeInfo& aTypeInfo)
@@ -311,15 +802,42 @@ namespace ecs
 		return myTypeInfo;
 	}
 
-	std::byte* ecs::Column::Release()
+	//Copy constructs aCount rows starting at aFirstRow from one element.
+	//Trivial columns copy the element once per chunk and then double the filled range with memcpy, so the fill runs at memory speed.
+	void Column::CopyConstructRows(const void* aSource, size_t aFirstRow, size_t aCount)
 	{
-		return myBuffer.release();
-	}
+		const size_t lastRow = aFirstRow + aCount;
+		if (!myTypeInfo.isTrivial)
+		{
+			for (size_t row = aFirstRow; row < lastRow; row++)
+			{
+				if (myTypeInfo.copy)
+				{
+					myTypeInfo.copy(GetComponent(row), aSource);
+				}
+				else if (myTypeInfo.construct)
+				{
+					myTypeInfo.construct(GetComponent(row));
+				}
+			}
+			return;
+		}
 
-	void* Column::GetComponent(size_t aIndex) const
-	{
-		assert(aIndex <= (GetCapacity()), "Trying to access element outside of buffer");
-		return myBuffer.get() + (aIndex * GetElementSize());;
+		const size_t size = GetElementSize();
+		for (size_t row = aFirstRow; row < lastRow;)
+		{
+			const size_t chunkEnd = std::min(lastRow, ((row >> myChunkShift) + 1) << myChunkShift);
+			const size_t numRows = chunkEnd - row;
+			std::byte* first = static_cast<std::byte*>(GetComponent(row));
+			std::memcpy(first, aSource, size);
+			for (size_t filled = 1; filled < numRows;)
+			{
+				const size_t numToCopy = std::min(filled, numRows - filled);
+				std::memcpy(first + filled * size, first, numToCopy * size);
+				filled += numToCopy;
+			}
+			row = chunkEnd;
+		}
 	}
 
 	void Column::MoveOrCopyDataFromTo(void* aFrom, void* aTo)
@@ -332,10 +850,10 @@ namespace ecs
 		{
 			myTypeInfo.move(aTo, aFrom);
 		}
-		/*else if (myTypeInfo.copy)
+		else if (myTypeInfo.copy)
 		{
 			myTypeInfo.copy(aTo, aFrom);
-		}*/
+		}
 	}
 
 }
@@ -1,31 +1,35 @@
 #pragma once
+#include <array>
+#include <bit>
 #include <cassert>
-#include <typeindex>
+#include <cstddef>
 #include <unordered_map>
-#include <unordered_set>
 #include <memory>
+#include <memory_resource>
 #include <ostream>
+#include <span>
 #include <vector>
 
 #include "Ecs_Aliases.h"
+#include "ComponentRegistry.h"
 namespace ecs
 {
 
 	struct TypeHash
 	{
-		size_t operator()(const std::vector<std::type_index>& types) const
+		size_t operator()(const Type& types) const
 		{
 			size_t seed = types.size();
 			for (const auto& type : types)
 			{
-				seed ^= type.hash_code() + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+				seed ^= type + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 			}
 			return seed;
 		}
 	};
 	struct TypeEqual
 	{
-		bool operator()(const std::vector<std::type_index>& lhs, const std::vector<std::type_index>& rhs) const
+		bool operator()(const Type& lhs, const Type& rhs) const
 		{
 			return lhs == rhs;
 		}
@@ -37,155 +41,123 @@ namespace ecs
 		int columnIndex;
 	};
 
-	struct ComponentTypeInfo
+	/// <summary>
+	/// True if aSignature has every component in aRequired and none in aExcluded.
+	/// </summary>
+	inline bool MatchesSignature(const ComponentMask& aSignature, const ComponentMask& aRequired, const ComponentMask& aExcluded)
 	{
-		ComponentID typeID;
-		size_t size = 0;											// Size of the component type in bytes
-		size_t alignment = 0;										// Alignment requirement of the type
-		void (*construct)(void* dest) = nullptr;					// Function pointer for default construction
-		void (*copy)(void* dest, const void* src) = nullptr;		// copy constructor
-		void (*move)(void* dest, void* src) = nullptr;				// Move constructor
-		void (*destruct)(void* obj) = nullptr;						// Destructor
-		bool isTrivial = false;
-
-		ComponentTypeInfo()
-			: typeID(typeid(nullptr)), size(0), alignment(0), construct(nullptr), copy(nullptr),
-			move(nullptr), destruct(nullptr), isTrivial(false) {
-		}
-
-		ComponentTypeInfo(const ComponentTypeInfo& aOther)
-			: typeID(aOther.typeID), size(aOther.size), alignment(aOther.alignment),
-			construct(aOther.construct), copy(aOther.copy), move(aOther.move),
-			destruct(aOther.destruct), isTrivial(aOther.isTrivial) {
-		}
-
-		ComponentTypeInfo(ComponentTypeInfo&& aOther) noexcept
-			: typeID(aOther.typeID), size(aOther.size), alignment(aOther.alignment),
-			construct(aOther.construct), copy(aOther.copy), move(aOther.move),
-			destruct(aOther.destruct), isTrivial(aOther.isTrivial)
-		{
-			aOther.construct = nullptr;
-			aOther.copy = nullptr;
-			aOther.move = nullptr;
-			aOther.destruct = nullptr;
-			aOther.isTrivial = false;
-		}
+		return (aSignature & aRequired) == aRequired && (aSignature & aExcluded).none();
+	}
 
-		ComponentTypeInfo& operator=(const ComponentTypeInfo& aOther)
+	/// <summary>
+	/// Calls aFunction with the id of every component in aMask, lowest first. The mask is read 64 ids at a time so only set bits cost anything.
+	/// </summary>
+	template<typename Function>
+	inline void ForEachComponent(const ComponentMask& aMask, Function&& aFunction)
+	{
+		static const ComponentMask lowWord(~0ull);
+		for (size_t word = 0; word < ECS_MAX_COMPONENTS / 64; word++)
 		{
-			if (this != &aOther)
+			uint64_t bits = ((aMask >> (word * 64)) & lowWord).to_ullong();
+			while (bits)
 			{
-
-				typeID = aOther.typeID;
-				size = aOther.size;
-				alignment = aOther.alignment;
-				construct = aOther.construct;
-				copy = aOther.copy;
-				move = aOther.move;
-				destruct = aOther.destruct;
-				isTrivial = aOther.isTrivial;
+				aFunction(static_cast<ComponentID>(word * 64 + std::countr_zero(bits)));
+				bits &= bits - 1;
 			}
-			return *this;
 		}
+	}
 
+	struct MemoryReclaimPolicy
+	{
+		bool enabled = true;
+		float occupancyThreshold = 0.25f;	// An archetype using less than this fraction of its rows counts as under occupied
+		uint32_t frameCount = 300;			// How many frames in a row it has to stay under occupied before chunks are released
+		size_t minChunks = 1;				// Chunks kept around even when empty so busy archetypes don't reallocate every burst
+	};
 
-		ComponentTypeInfo& operator=(ComponentTypeInfo&& aOther) noexcept
+	struct ChunkDeleter
+	{
+		std::pmr::memory_resource* resource = nullptr;
+		size_t size = 0;
+		size_t alignment = ECS_COLUMN_ALIGNMENT;
+		void operator()(std::byte* aChunk) const
 		{
-			if (this != &aOther)
-			{
-				typeID = aOther.typeID;
-				size = aOther.size;
-				alignment = std::move(aOther.alignment);
-				construct = std::move(aOther.construct);
-				copy = std::move(aOther.copy);
-				move = std::move(aOther.move);
-				destruct = std::move(aOther.destruct);
-				isTrivial = aOther.isTrivial;
-
-				aOther.construct = nullptr;
-				aOther.copy = nullptr;
-				aOther.move = nullptr;
-				aOther.destruct = nullptr;
-				aOther.isTrivial = false;
-			}
-			return *this;
+			resource->deallocate(aChunk, size, alignment);
 		}
-
 	};
+	using ChunkPtr = std::unique_ptr<std::byte[], ChunkDeleter>;
 
 	class Column
 	{
 	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
 		Column() = default;
-		~Column()
-		{
-			//myBuffer.reset();
-		};
-		Column(Column&& other) noexcept
-		{
-			myBuffer = std::move(other.myBuffer);
-			myCapacity = other.myCapacity;
-			myCurrentMemoryUsed = other.myCurrentMemoryUsed;
-			myTypeInfo = other.myTypeInfo;
-		}
-		Column& operator=(Column&& other) noexcept
-		{
-			if (this != &other)
-			{
-				myCapacity = other.myCapacity;
-				myCurrentMemoryUsed = other.myCurrentMemoryUsed;
-				myTypeInfo = std::move(other.myTypeInfo);
-				myBuffer.reset(other.Release());
-			}
-			return *this;
-		}
-		Column(const Column& aOther)
-		{
-			myBuffer.reset(aOther.myBuffer.get());
-			myCapacity = aOther.myCapacity;
-			myCurrentMemoryUsed = aOther.myCurrentMemoryUsed;
-			myTypeInfo = aOther.myTypeInfo;
-		};
-		Column& operator=(const Column&)
-		{
-			return *this;
-		};
+		explicit Column(const allocator_type& aAllocator);
+		Column(const Column& aColumn) = default;
+		Column(const Column& aColumn, const allocator_type& aAllocator);
+		Column(Column&& aColumn) noexcept = default;
+		Column(Column&& aColumn, const allocator_type& aAllocator);
+		Column& operator=(const Column& aColumn) = default;
+		Column& operator=(Column&& aColumn) noexcept = default;
 
 		size_t GetElementSize() const;
 		size_t GetCurrentMemoryUsed() const;
 		size_t GetCapacity() const;
-		void SetCapacity(size_t aCapacity);
-		void Reset(std::byte* aBuffer);
-		void Resize(size_t aNewSize);
+		size_t GetChunkCapacity() const;
+		size_t GetNumChunks() const;
+		void SetChunkShift(size_t aChunkShift);
+		void AddChunk(std::byte* aChunk);
+		void PopChunk();
+		void ClearChunks();
+		std::byte* GetChunk(size_t aChunkIndex) const;
 		void AssignTypeInfo(const ComponentTypeInfo& aTypeInfo);
 		void ChangeMemoryUsed(int aNumElements);
 		const ComponentTypeInfo& GetTypeInfo() const;
-		std::byte* Release();
-		void* GetComponent(size_t aIndex) const;
+		void* GetComponent(size_t aIndex) const
+		{
+			assert(aIndex < GetChunkCapacity() * myChunks.size(), "Trying to access element outside of buffer");
+			return myChunks[aIndex >> myChunkShift] + ((aIndex & (GetChunkCapacity() - 1)) * GetElementSize());
+		}
 		void* operator[](const size_t aIndex) const
 		{
-			assert(aIndex <= (myCapacity), "Trying to access element outside of buffer");
-			return myBuffer.get() + (aIndex * GetElementSize());
+			return GetComponent(aIndex);
 		}
 		void MoveOrCopyDataFromTo(void* aFrom, void* aTo);
+		void CopyConstructRows(const void* aSource, size_t aFirstRow, size_t aCount);
 
 	private:
-		std::unique_ptr<std::byte[]> myBuffer; //Component storage
+		std::pmr::vector<std::byte*> myChunks; //This columns slice of every archetype chunk, the archetype owns the memory
 		ComponentTypeInfo myTypeInfo;
-		size_t myCapacity = 0;
+		size_t myChunkShift = 0; //Rows per chunk is always a power of two so a row splits into chunk and offset with a shift and a mask
 		size_t myCurrentMemoryUsed = 0;
 
 	};
 
+	struct ArchetypeEdge
+	{
+		ArchetypeEdge() = default;
+
+		Archetype* addArchetypes = nullptr;
+		Archetype* removeArchetypes = nullptr;
+
+	};
+
 	class Archetype
 	{
 	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
 		Archetype() = default;
+		explicit Archetype(const allocator_type& aAllocator);
 		~Archetype() = default;
 		Archetype(Archetype&& aArchetype) noexcept;
-		Archetype& operator=(const Archetype& aArchetype);
+		Archetype(Archetype&& aArchetype, const allocator_type& aAllocator);
+		Archetype& operator=(const Archetype& aArchetype) = delete; //Archetypes own their chunks
 		Archetype& operator=(Archetype&& aArchetype);
 
+		allocator_type	get_allocator() const;
+
 		size_t			GetLastRow() const;
 		size_t			GetEntityRow(EntityID aEntity) const;
 		ArchetypeID		GetID() const;
@@ -195,56 +167,90 @@ namespace ecs
 		size_t			GetNumTypes() const;
 		size_t			GetMaxCount() const;
 		void			SetType(const Type& aType);
-		void			SetMaxCount(size_t aMaxCount);
+		size_t			GetChunkCapacity() const;
+		size_t			GetNumChunks() const;
+		void			AddChunk();
+		void			ReserveRows(size_t aRows);
+		size_t			GetChunkMemory() const;
+		size_t			ReleaseUnusedChunks(size_t aMinChunks = 0);
+		size_t			UpdateMemoryReclaim(const MemoryReclaimPolicy& aPolicy);
 		Column* GetColumn(size_t aColumnIndex);
 		size_t			GetNumComponents() const;
 		size_t			GetComponentCapacity() const;
 		ecs::EntityID	GetEntity(size_t aRow) const;
-		void			AddComponentIDToTypeSet(ComponentID aComponentID);
+		const ComponentMask& GetSignature() const;
 		bool			HasComponent(ComponentID aComponentID) const;
 		size_t			GetNumEntities() const;
 		ArchetypeEdge& GetEdge(ComponentID aID);
 		ArchetypeEdge& GetOrAddEdge(ComponentID aID);
+		ArchetypeEdge* FindEdge(ComponentID aID);
+		void			ClearEdges();
 		void			ReserveComponentsSize(size_t aSize);
 		void			ResizeComponents(size_t aSize);
 		bool			IsEmpty() const;
 		void			Reset();
 		void			Reset(Archetype& aArchetype);
 		void			AddEmptyComp();
-		std::vector<EntityID>& GetEntityList();
+		std::pmr::vector<EntityID>& GetEntityList();
 
 		void			AddEntity(ecs::EntityID aEntity);
-		bool			Contains(const Type& type) const;
+		void			RemoveLastEntity();
+		void			SetEntityCounts(size_t* aEntityCounts);
+		bool			Contains(const ComponentMask& aMask) const;
 
 		template <typename... Filter>
 		bool			Contains(std::tuple<Filter...> filters) const;
 
 		ArchetypeEdge& AddEdge(ComponentID aComponentID);
 		int			FindColumnIndex(ComponentID aComponentID) const;
+		void*			GetComponent(ComponentID aComponentID, size_t aRow);
 		void			ShuffleEntity(size_t aFromRow, size_t aToRow);
+		void			RemoveRows(std::span<const size_t> aRows);
+
+		int				FindTypeIndex(ComponentID aComponentID) const;
+		void			SetComponentEnabled(ComponentID aComponentID, size_t aRow, bool aEnabled);
+		bool			IsComponentEnabled(ComponentID aComponentID, size_t aRow) const;
+		bool			HasDisabledComponents() const;
+		uint64_t		GetEnabledRows(const ComponentMask& aComponents, size_t aBlock) const;
+		void			CopyEnabledState(const Archetype& aSource, size_t aSourceRow, size_t aRow);
+
+		void			SetChangedTick(size_t aSlot, size_t aRow, ChangeTick aTick);
+		void			ClampChangedTicks(const ComponentMask& aComponents, size_t aRow, ChangeTick aTick);
+		void			SetRowsAdded(size_t aFirstRow, size_t aLastRow, ChangeTick aTick);
+		void			CopyChangeTicks(const Archetype& aSource, size_t aSourceRow, size_t aRow, ChangeTick aTick);
+		bool			HasChangesSince(const ComponentMask& aChanged, const ComponentMask& aAdded, ChangeTick aTick) const;
+		bool			IsRowChangedSince(const ComponentMask& aChanged, const ComponentMask& aAdded, size_t aRow, ChangeTick aTick) const;
 	private:
 
 		ArchetypeID myID{ 0 };
 		Type myType{};						//The order of components in the component list
-		std::unordered_set<ComponentID> typeSet{};
-		std::vector<Column> components{}; //Columns holding the data, use the entity row to access the specific component
-		std::vector<EntityID> entities{}; //serves as our entity list but the order of entities are also the rows in the component columns
-		std::unordered_map<ComponentID, ArchetypeEdge> edges{};
-		size_t myMaxCount = size_t(0);
+		ComponentMask mySignature{};		//One bit per component id, used for constant time HasComponent and query matching
+		std::pmr::vector<int> myColumnLookup{}; //Indexed by component id, column of that component or -1 for tags and missing components
+		std::pmr::vector<Column> components{}; //Columns holding the data, use the entity row to access the specific component
+		std::pmr::vector<EntityID> entities{}; //serves as our entity list but the order of entities are also the rows in the component columns
+		std::pmr::vector<uint64_t> myEnabledRows{}; //Empty until a component is disabled, then a 64 row block per type slot at [row / 64 * types + slot], set bits are enabled
+		std::pmr::vector<ChangeTick> myAddedTicks{}; //World change tick each component was added at, [row * types + slot], 0 is never
+		std::pmr::vector<ChangeTick> myChangedTicks{}; //World change tick each component was last written at, same layout
+		std::pmr::vector<ChangeTick> myNewestAddedTicks{}; //Newest tick in each type slot so change filters can skip the whole archetype
+		std::pmr::vector<ChangeTick> myNewestChangedTicks{};
+		std::array<ArchetypeEdge, ECS_LOW_EDGE_COUNT> myLowEdges{}; //Edges for the low component ids, most tags and common components live here
+		std::pmr::vector<ArchetypeEdge> edges{}; //Edges for the remaining ids, indexed by component id - ECS_LOW_EDGE_COUNT and grown on demand
+		std::pmr::vector<ChunkPtr> myChunks{}; //Fixed size blocks holding a range of rows for every column, allocated from the archetypes memory resource
+		std::pmr::vector<size_t> myColumnOffsets{}; //Where each columns slice starts inside a chunk
+		size_t myChunkShift = 0;
+		size_t myChunkBytes = 0;
+		size_t myChunkAlignment = ECS_COLUMN_ALIGNMENT;
+		uint32_t myFramesUnderOccupied = 0;
+		size_t* myEntityCounts = nullptr; //Per component entity counts of the world the archetype is registered in, indexed by component id
+
+		void			CalculateChunkLayout();
+		void			ChangeEntityCount(ptrdiff_t aDelta);
+		void			TakeChunks(Archetype& aArchetype);
 
 		friend std::ostream& operator<<(std::ostream& os, const Archetype& aArchetype);
 
 	};
 
-
-	struct ArchetypeEdge
-	{
-		ArchetypeEdge() = default;
-
-		Archetype* addArchetypes = nullptr;
-		Archetype* removeArchetypes = nullptr;
-
-	};
 	struct Record
 	{
 		Archetype* archetype;
@@ -253,11 +259,6 @@ namespace ecs
 	template<typename ...Filter>
 	inline bool Archetype::Contains(std::tuple<Filter...> filters) const
 	{
-		return std::apply(
-			[this](auto&&... args)
-			{
-				return (HasComponent(typeid(args)) || ...);
-
-			}, filters);
+		return (HasComponent(GetComponentID<Filter>()) || ...);
 	}
 }
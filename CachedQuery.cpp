@@ -0,0 +1,46 @@
+#include "CachedQuery.h"
+#include "World.h"
+namespace ecs
+{
+	CachedQuery::CachedQuery(World* aWorld, const QueryTerms& aTerms)
+		: myWorld(aWorld), myTerms(aTerms)
+	{
+	}
+
+	QueryIterator CachedQuery::begin()
+	{
+		if (!myWorld) return QueryIterator();
+
+		QueryCache& cache = GetCache();
+		const ChangeTick changedSince = myTerms.HasChangeFilter() ? myWorld->AdvanceChangeTick(myLastRunTick) : 0;
+		return QueryIterator(myWorld, cache.archetypes, cache.denseRequired, cache.sparseRequired, cache.sparseExcluded,
+			myTerms.changed, myTerms.added, changedSince, myLastRunTick).begin();
+	}
+
+	QueryIterator CachedQuery::end()
+	{
+		if (!myWorld) return QueryIterator();
+
+		const QueryCache& cache = GetCache();
+		return QueryIterator(cache.archetypes, cache.archetypes.size(), 0, myWorld);
+	}
+
+	size_t CachedQuery::GetNumArchetypes()
+	{
+		return myWorld ? GetCache().archetypes.size() : 0;
+	}
+
+	QueryCache& CachedQuery::GetCache()
+	{
+		if (!myCache)
+		{
+			std::lock_guard<std::mutex> lock(myWorld->myMutex);
+			//The change filters are left out of the key since the query keeps its own last run tick, queries that only differ in them share one list
+			QueryTerms terms = myTerms;
+			terms.changed.reset();
+			terms.added.reset();
+			myCache = &myWorld->GetQueryCache(terms);
+		}
+		return *myCache;
+	}
+}
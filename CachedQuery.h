@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <source_location>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Ecs_Aliases.h"
+#include "ComponentRegistry.h"
+#include "Archetype.h"
+#include "QueryTerms.h"
+namespace ecs
+{
+	class World;
+	class Archetype;
+	class QueryIterator;
+
+	//Archetypes matching one set of query terms, owned by the world.
+	//New archetypes are appended when they are created, archetypes are never removed so the list only grows.
+	struct QueryCache
+	{
+		QueryTerms terms; //As asked for, dense and sparse components mixed. The change filters are part of the key
+		ComponentMask denseRequired; //Matched against archetype signatures
+		ComponentMask denseExcluded;
+		ComponentMask sparseRequired; //Checked per entity while iterating
+		ComponentMask sparseExcluded;
+		std::pmr::vector<Archetype*> archetypes; //Empty archetypes stay in the list and are skipped while iterating
+		std::pmr::unordered_map<size_t, ChangeTick> lastRunTicks; //Per call site of Query or Each, only used with change filters. CachedQuery keeps its own
+
+		bool Matches(const ComponentMask& aSignature) const
+		{
+			return MatchesSignature(aSignature, denseRequired, denseExcluded) && terms.MatchesGroups(aSignature);
+		}
+
+		//World change tick the query last ran at from aCallSite, call sites are told apart by file, line and column
+		ChangeTick& GetLastRunTick(const std::source_location& aCallSite)
+		{
+			size_t key = std::hash<std::string_view>()(aCallSite.file_name());
+			key ^= (size_t(aCallSite.line()) << 32 | aCallSite.column()) + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+			return lastRunTicks[key];
+		}
+	};
+
+	//How the world matches one query, returned by World::ExplainQuery
+	struct QueryPlan
+	{
+		struct Term
+		{
+			ComponentID componentID;
+			size_t numArchetypes; //Archetypes that have the component, 0 for sparse components
+			size_t numEntities;
+			bool isSparse; //Checked per entity while iterating instead of per archetype
+		};
+
+		ComponentID seedComponent = ECS_COMPONENT_NULL; //Required component whose archetype map the candidates come from, ECS_COMPONENT_NULL scans every archetype
+		size_t numCandidates = 0; //Archetype signatures tested when the archetype list is built
+		size_t numArchetypes = 0; //Archetypes that matched
+		size_t numRows = 0; //Rows in the matched archetypes, the most a single iteration visits
+		std::vector<Term> required; //Rarest first
+	};
+
+	/// <summary>
+	/// A query that lives across frames, made with World::MakeQuery.
+	/// The matching archetypes are looked up once and the world keeps the list up to date as archetypes are created,
+	/// so iterating it costs nothing up front. Copies share the same list.
+	/// Changed and Added terms match what changed since this query was last iterated.
+	/// </summary>
+	class CachedQuery
+	{
+	public:
+		CachedQuery() = default;
+		CachedQuery(World* aWorld, const QueryTerms& aTerms);
+
+		/// <summary>
+		/// Adds terms to the query, plain components are required and any other query term like Optional<T>, AnyOf<Ts...> or Changed<T> works as well.
+		/// </summary>
+		template<typename... Components>
+		CachedQuery& With();
+
+		/// <summary>
+		/// Leaves out entities that have any of the given components.
+		/// </summary>
+		template<typename... Filter>
+		CachedQuery& Without();
+
+		QueryIterator begin();
+		QueryIterator end();
+
+		/// <summary>
+		/// Amount of matching archetypes, including the ones that are empty right now.
+		/// </summary>
+		size_t GetNumArchetypes();
+
+	private:
+		World* myWorld = nullptr;
+		QueryTerms myTerms;
+		ChangeTick myLastRunTick = 0;
+		QueryCache* myCache = nullptr; //Looked up on first use, the world keeps it up to date from then on
+
+		QueryCache& GetCache();
+	};
+
+	template<typename... Components>
+	inline CachedQuery& CachedQuery::With()
+	{
+		(QueryTerm<Components>::Apply(myTerms), ...);
+		myCache = nullptr;
+		return *this;
+	}
+
+	template<typename... Filter>
+	inline CachedQuery& CachedQuery::Without()
+	{
+		QueryTerm<ecs::Without<Filter...>>::Apply(myTerms);
+		myCache = nullptr;
+		return *this;
+	}
+}
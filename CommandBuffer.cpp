@@ -0,0 +1,107 @@
+#include "CommandBuffer.h"
+#include "ecs_World.h"
+#include <algorithm>
+namespace ecs
+{
+	CommandBuffer::CommandBuffer(World* aWorld, const allocator_type& aAllocator)
+		: myWorld(aWorld), myCommands(aAllocator), myPages(aAllocator), myLargePages(aAllocator)
+	{
+	}
+
+	CommandBuffer::~CommandBuffer()
+	{
+		Clear();
+	}
+
+	EntityID CommandBuffer::Create()
+	{
+		const EntityID entity = myWorld->GenerateID();
+		myCommands.push_back(Command{ CommandType::Create, ECS_COMPONENT_NULL, entity, nullptr });
+		return entity;
+	}
+
+	void CommandBuffer::DestroyEntity(EntityID aEntity)
+	{
+		myCommands.push_back(Command{ CommandType::Destroy, ECS_COMPONENT_NULL, aEntity, nullptr });
+	}
+
+	bool CommandBuffer::IsEmpty() const
+	{
+		return myCommands.empty();
+	}
+
+	size_t CommandBuffer::GetNumCommands() const
+	{
+		return myCommands.size();
+	}
+
+	size_t CommandBuffer::GetNumPayloadPages() const
+	{
+		return myPages.size() + myLargePages.size();
+	}
+
+	void CommandBuffer::Clear()
+	{
+		for (const Command& command : myCommands)
+		{
+			if (!command.payload) continue;
+
+			const ComponentTypeInfo& typeInfo = ComponentRegistry::GetTypeInfo(command.componentID);
+			if (!typeInfo.isTrivial && typeInfo.destruct)
+			{
+				typeInfo.destruct(command.payload);
+			}
+		}
+		myCommands.clear();
+		myPageIndex = 0;
+		myPageOffset = 0;
+		for (LargePage& page : myLargePages)
+		{
+			page.offset = 0;
+		}
+	}
+
+	void* CommandBuffer::AllocatePayload(size_t aSize, size_t aAlignment)
+	{
+		std::pmr::memory_resource* resource = myPages.get_allocator().resource();
+		if (aSize > ECS_CHUNK_SIZE || aAlignment > ECS_COLUMN_ALIGNMENT)
+		{
+			//Kept apart so they never move the cursor of the regular pages, first fit since there are only ever a few
+			for (LargePage& page : myLargePages)
+			{
+				if (page.alignment < aAlignment) continue;
+
+				const size_t offset = (page.offset + aAlignment - 1) & ~(aAlignment - 1);
+				if (offset + aSize <= page.size)
+				{
+					page.offset = offset + aSize;
+					return page.memory.get() + offset;
+				}
+			}
+
+			const size_t alignment = std::max(ECS_COLUMN_ALIGNMENT, aAlignment);
+			const size_t size = std::max(ECS_CHUNK_SIZE, aSize);
+			std::byte* memory = static_cast<std::byte*>(resource->allocate(size, alignment));
+			myLargePages.push_back(LargePage{ ChunkPtr(memory, ChunkDeleter{ resource, size, alignment }), size, alignment, aSize });
+			return memory;
+		}
+
+		while (myPageIndex < myPages.size())
+		{
+			const size_t offset = (myPageOffset + aAlignment - 1) & ~(aAlignment - 1);
+			if (offset + aSize <= ECS_CHUNK_SIZE)
+			{
+				myPageOffset = offset + aSize;
+				return myPages[myPageIndex].get() + offset;
+			}
+			myPageIndex++;
+			myPageOffset = 0;
+		}
+
+		std::byte* page = static_cast<std::byte*>(resource->allocate(ECS_CHUNK_SIZE, ECS_COLUMN_ALIGNMENT));
+		myPages.emplace_back(page, ChunkDeleter{ resource, ECS_CHUNK_SIZE, ECS_COLUMN_ALIGNMENT });
+		myPageIndex = myPages.size() - 1;
+		myPageOffset = aSize;
+		return page;
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Ecs_Aliases.h"
+#include "ComponentRegistry.h"
+#include "Archetype.h"
+namespace ecs
+{
+	class World;
+
+	/// <summary>
+	/// Records structural changes to be played back later by World::FlushCommands, which runs between the pipeline phases.
+	/// Every thread gets its own buffer from World::GetCommandBuffer so recording never locks, and since nothing moves
+	/// until playback it is safe to record while iterating a query. A buffer must not be recorded into while the world is flushing.
+	/// </summary>
+	class CommandBuffer
+	{
+	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
+		explicit CommandBuffer(World* aWorld, const allocator_type& aAllocator = {});
+		CommandBuffer(const CommandBuffer&) = delete;
+		CommandBuffer& operator=(const CommandBuffer&) = delete;
+		~CommandBuffer();
+
+		/// <summary>
+		/// Reserves an entity ID right away, the entity is created when the buffer is played back.
+		/// </summary>
+		EntityID		Create();
+		void			DestroyEntity(EntityID aEntity);
+
+		/// <summary>
+		/// Adds a default constructed component on playback, does nothing if the entity already has it.
+		/// </summary>
+		template<typename T>
+		void			AddComponent(EntityID aEntity);
+
+		/// <summary>
+		/// Adds the component with the given value on playback, an existing component is overwritten.
+		/// </summary>
+		template<typename T>
+		void			AddComponent(EntityID aEntity, T aComponent);
+
+		template<typename T>
+		void			RemoveComponent(EntityID aEntity);
+
+		bool			IsEmpty() const;
+		size_t			GetNumCommands() const;
+
+		/// <summary>
+		/// Pages holding recorded component values, they are kept between flushes so this stays flat once the buffer is warmed up.
+		/// </summary>
+		size_t			GetNumPayloadPages() const;
+
+		/// <summary>
+		/// Drops every recorded command and destroys the component values that were recorded with them.
+		/// </summary>
+		void			Clear();
+
+	private:
+		friend class World;
+
+		enum class CommandType : uint8_t
+		{
+			Create,
+			Destroy,
+			Add,
+			Remove
+		};
+
+		struct Command
+		{
+			CommandType type;
+			ComponentID componentID = ECS_COMPONENT_NULL;
+			EntityID entity;
+			void* payload = nullptr; //Recorded component value, constructed in the payload pages
+		};
+
+		//Page for values bigger than ECS_CHUNK_SIZE or aligned stricter than ECS_COLUMN_ALIGNMENT
+		struct LargePage
+		{
+			ChunkPtr memory;
+			size_t size;
+			size_t alignment;
+			size_t offset; //Bytes in use since the last Clear
+		};
+
+		World* myWorld;
+		std::pmr::vector<Command> myCommands;
+		std::pmr::vector<ChunkPtr> myPages; //Payload storage of ECS_CHUNK_SIZE, pages are kept between frames and never move
+		std::pmr::vector<LargePage> myLargePages; //Kept between frames as well, any value that fits reuses them
+		size_t myPageIndex = 0;
+		size_t myPageOffset = 0;
+
+		void*			AllocatePayload(size_t aSize, size_t aAlignment);
+	};
+
+	template<typename T>
+	inline void CommandBuffer::AddComponent(EntityID aEntity)
+	{
+		myCommands.push_back(Command{ CommandType::Add, GetComponentID<T>(), aEntity, nullptr });
+	}
+
+	template<typename T>
+	inline void CommandBuffer::AddComponent(EntityID aEntity, T aComponent)
+	{
+		if constexpr (std::is_empty<T>::value)
+		{
+			AddComponent<T>(aEntity);
+		}
+		else
+		{
+			void* payload = new (AllocatePayload(sizeof(T), alignof(T))) T(std::move(aComponent));
+			myCommands.push_back(Command{ CommandType::Add, GetComponentID<T>(), aEntity, payload });
+		}
+	}
+
+	template<typename T>
+	inline void CommandBuffer::RemoveComponent(EntityID aEntity)
+	{
+		myCommands.push_back(Command{ CommandType::Remove, GetComponentID<T>(), aEntity, nullptr });
+	}
+}
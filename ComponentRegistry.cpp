@@ -0,0 +1,35 @@
+#include "ComponentRegistry.h"
+namespace ecs
+{
+	std::array<ComponentTypeInfo, ECS_MAX_COMPONENTS> ComponentRegistry::myTypeInfos;
+	std::atomic<ComponentID> ComponentRegistry::myNumComponents{ 0 };
+	std::mutex ComponentRegistry::myMutex;
+
+	const ComponentTypeInfo& ComponentRegistry::GetTypeInfo(ComponentID aComponentID)
+	{
+		assert(aComponentID < myNumComponents.load(std::memory_order_acquire), "Component was never registered");
+		return myTypeInfos[aComponentID];
+	}
+
+	std::string_view ComponentRegistry::GetName(ComponentID aComponentID)
+	{
+		return GetTypeInfo(aComponentID).name;
+	}
+
+	size_t ComponentRegistry::GetNumComponents()
+	{
+		return myNumComponents.load(std::memory_order_acquire);
+	}
+
+	ComponentID ComponentRegistry::Add(ComponentTypeInfo&& aTypeInfo)
+	{
+		const std::lock_guard<std::mutex> lock(myMutex);
+		const ComponentID id = myNumComponents.load(std::memory_order_relaxed);
+		assert(id < ECS_MAX_COMPONENTS, "Too many component types, raise ECS_MAX_COMPONENTS");
+
+		aTypeInfo.typeID = id;
+		myTypeInfos[id] = std::move(aTypeInfo);
+		myNumComponents.store(id + 1, std::memory_order_release);
+		return id;
+	}
+}
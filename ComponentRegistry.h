@@ -0,0 +1,183 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "Ecs_Aliases.h"
+namespace ecs
+{
+	struct ComponentTypeInfo
+	{
+		ComponentID typeID;
+		size_t size = 0;											// Size of the component type in bytes
+		size_t alignment = 0;										// Alignment requirement of the type
+		void (*construct)(void* dest) = nullptr;					// Function pointer for default construction
+		void (*copy)(void* dest, const void* src) = nullptr;		// copy constructor
+		void (*move)(void* dest, void* src) = nullptr;				// Move constructor
+		void (*destruct)(void* obj) = nullptr;						// Destructor
+		bool isTrivial = false;
+		bool isTag = false;											// Empty types never get a column
+		std::string_view name;										// Type name taken from the compiler, no RTTI needed
+
+		ComponentTypeInfo()
+			: typeID(ECS_COMPONENT_NULL), size(0), alignment(0), construct(nullptr), copy(nullptr),
+			move(nullptr), destruct(nullptr), isTrivial(false), isTag(false) {
+		}
+
+		ComponentTypeInfo(const ComponentTypeInfo& aOther)
+			: typeID(aOther.typeID), size(aOther.size), alignment(aOther.alignment),
+			construct(aOther.construct), copy(aOther.copy), move(aOther.move),
+			destruct(aOther.destruct), isTrivial(aOther.isTrivial), isTag(aOther.isTag), name(aOther.name) {
+		}
+
+		ComponentTypeInfo(ComponentTypeInfo&& aOther) noexcept
+			: typeID(aOther.typeID), size(aOther.size), alignment(aOther.alignment),
+			construct(aOther.construct), copy(aOther.copy), move(aOther.move),
+			destruct(aOther.destruct), isTrivial(aOther.isTrivial), isTag(aOther.isTag), name(aOther.name)
+		{
+			aOther.construct = nullptr;
+			aOther.copy = nullptr;
+			aOther.move = nullptr;
+			aOther.destruct = nullptr;
+			aOther.isTrivial = false;
+		}
+
+		ComponentTypeInfo& operator=(const ComponentTypeInfo& aOther)
+		{
+			if (this != &aOther)
+			{
+
+				typeID = aOther.typeID;
+				size = aOther.size;
+				alignment = aOther.alignment;
+				construct = aOther.construct;
+				copy = aOther.copy;
+				move = aOther.move;
+				destruct = aOther.destruct;
+				isTrivial = aOther.isTrivial;
+				isTag = aOther.isTag;
+				name = aOther.name;
+			}
+			return *this;
+		}
+
+
+		ComponentTypeInfo& operator=(ComponentTypeInfo&& aOther) noexcept
+		{
+			if (this != &aOther)
+			{
+				typeID = aOther.typeID;
+				size = aOther.size;
+				alignment = std::move(aOther.alignment);
+				construct = std::move(aOther.construct);
+				copy = std::move(aOther.copy);
+				move = std::move(aOther.move);
+				destruct = std::move(aOther.destruct);
+				isTrivial = aOther.isTrivial;
+				isTag = aOther.isTag;
+				name = aOther.name;
+
+				aOther.construct = nullptr;
+				aOther.copy = nullptr;
+				aOther.move = nullptr;
+				aOther.destruct = nullptr;
+				aOther.isTrivial = false;
+			}
+			return *this;
+		}
+
+	};
+
+	/// <summary>
+	/// Process wide table of every component type that has been used, indexed by its dense ComponentID.
+	/// IDs are handed out in order of first use and never change while the program runs.
+	/// </summary>
+	class ComponentRegistry
+	{
+	public:
+		template<typename T>
+		static ComponentID Register();
+
+		static const ComponentTypeInfo& GetTypeInfo(ComponentID aComponentID);
+		static std::string_view GetName(ComponentID aComponentID);
+		static size_t GetNumComponents();
+
+	private:
+		static ComponentID Add(ComponentTypeInfo&& aTypeInfo);
+
+		static std::array<ComponentTypeInfo, ECS_MAX_COMPONENTS> myTypeInfos;
+		static std::atomic<ComponentID> myNumComponents;
+		static std::mutex myMutex;
+	};
+
+	template<typename T>
+	constexpr std::string_view GetTypeName()
+	{
+#if defined(_MSC_VER)
+		constexpr std::string_view signature = __FUNCSIG__;
+		constexpr std::string_view prefix = "GetTypeName<";
+		constexpr size_t begin = signature.find(prefix) + prefix.size();
+		constexpr size_t end = signature.rfind(">(void)");
+#else
+		constexpr std::string_view signature = __PRETTY_FUNCTION__;
+		constexpr std::string_view prefix = "T = ";
+		constexpr size_t begin = signature.find(prefix) + prefix.size();
+		constexpr size_t end = signature.find_first_of(";]", begin);
+#endif
+		return signature.substr(begin, end - begin);
+	}
+
+	template<typename T>
+	ComponentID ComponentRegistry::Register()
+	{
+		ComponentTypeInfo typeInfo;
+
+		typeInfo.size = sizeof(T);
+		typeInfo.alignment = alignof(T);
+		typeInfo.isTag = std::is_empty_v<T>;
+		typeInfo.name = GetTypeName<T>();
+
+		// Default constructor
+		if constexpr (std::is_default_constructible_v<T>)
+			typeInfo.construct = [](void* dest) { new (dest) T(); };
+
+		// Copy constructor
+		if constexpr (std::is_copy_constructible_v<T>)
+			typeInfo.copy = [](void* dest, const void* src) { new (dest) T(*reinterpret_cast<const T*>(src)); };
+
+		// Move constructor
+		if constexpr (std::is_move_constructible_v<T>)
+			typeInfo.move = [](void* dest, void* src) { new (dest) T(std::move(*reinterpret_cast<T*>(src))); };
+
+		// Destructor
+		if constexpr (std::is_destructible_v<T>)
+			typeInfo.destruct = [](void* obj) { reinterpret_cast<T*>(obj)->~T(); };
+
+		//Trivial copyable check
+		typeInfo.isTrivial = std::is_trivially_copyable_v<T>;
+
+		return Add(std::move(typeInfo));
+	}
+
+	/// <summary>
+	/// Returns the dense ID of a component type, the type is registered the first time this is called for it.
+	/// </summary>
+	template<typename T>
+	inline ComponentID GetComponentID()
+	{
+		if constexpr (std::is_const_v<T> || std::is_volatile_v<T>)
+		{
+			return GetComponentID<std::remove_cv_t<T>>();
+		}
+		else
+		{
+			static const ComponentID id = ComponentRegistry::Register<T>();
+			return id;
+		}
+	}
+}
@@ -1,9 +1,17 @@
 #pragma once
+#include <bitset>
 #include <vector>
 #include <unordered_map>
 #include <functional>
-#include <typeindex>
+#include <memory_resource>
+#include <cstdint>
 static constexpr uint64_t ECS_ENTITY_NULL = 0;
+static constexpr uint32_t ECS_COMPONENT_NULL = UINT32_MAX;
+static constexpr size_t ECS_MAX_COMPONENTS = 256; //Upper bound for dense component ids, tables indexed by component id are this big
+static constexpr size_t ECS_CHUNK_SIZE = 16 * 1024; //Target size in bytes of one archetype chunk, rows per chunk is derived from the size of a row
+static constexpr size_t ECS_LOW_EDGE_COUNT = 16; //Component ids below this get their archetype graph edge stored inline in the archetype
+static constexpr size_t ECS_COLUMN_ALIGNMENT = 64; //Every column slice starts on a cache line, wide enough for aligned AVX-512 loads
+static constexpr size_t ECS_OBSERVER_TYPE_COUNT = 3; //OnSet, OnAdd and OnRemove, event streams are indexed by component id * this + observer type
 
 namespace ecs
 {
@@ -21,16 +29,18 @@ namespace ecs
 	};
 
 	using ArchetypeID = uint64_t;
-	using ComponentID = std::type_index;
+	using ComponentID = uint32_t; //Dense id handed out by the ComponentRegistry, indexes the component tables directly
 	using EntityID = uint64_t;
-	using Type = std::vector<ComponentID>; //This vector needs to be sorted 
+	using ChangeTick = uint64_t; //World change tick components are stamped with, 64 bits so it never wraps around, 0 is never
+	using Type = std::pmr::vector<ComponentID>; //This vector needs to be sorted 
+	using ComponentMask = std::bitset<ECS_MAX_COMPONENTS>; //Archetype signature, one bit per component id
 	// Used to lookup components in archetypes
-	using ArchetypeMap = std::unordered_map<ArchetypeID, ArchetypeRecord>;
-	using ObserverList = std::vector<std::function<void()>>;
-	using ObserverLists = std::unordered_map <ObserverType, ObserverList>;
-	using ObserverRecord = std::unordered_map<EntityID, ObserverLists>;
-	using ObserverMap = std::unordered_map<ComponentID, ObserverRecord>;
-	using ComponentIndex = std::unordered_map<ComponentID, ArchetypeMap>;
-	using ArchetypeIndex = std::unordered_map<Type, Archetype, TypeHash, TypeEqual>;
-	using EntityIndex = std::unordered_map<EntityID, Record>;
+	// All containers draw from the memory resource of the world that owns them
+	using ArchetypeMap = std::pmr::unordered_map<ArchetypeID, ArchetypeRecord>;
+	using ObserverList = std::pmr::vector<std::function<void()>>;
+	using ObserverLists = std::pmr::unordered_map <ObserverType, ObserverList>;
+	using ObserverRecord = std::pmr::unordered_map<EntityID, ObserverLists>;
+	using ObserverMap = std::pmr::vector<ObserverRecord>; //Indexed by component id
+	using ComponentIndex = std::pmr::vector<ArchetypeMap>; //Indexed by component id
+	using ArchetypeIndex = std::pmr::unordered_map<Type, Archetype, TypeHash, TypeEqual>;
 }
\ No newline at end of file
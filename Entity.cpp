@@ -35,36 +35,43 @@ namespace ecs
 		myWorld->SetDontDestroyOnLoad(myID);
 	}
 
+	static JPH::Mat44 ComposeLocalTransform(const Scale& aScale, const Rotation& aRotation, const Position& aPosition)
+	{
+		JPH::Mat44 localTransform = JPH::Mat44::sIdentity();
+		localTransform.SetDiagonal3(JPH::Vec3(aScale.scale));
+		JPH::Quat rotatino = aRotation.rotation.Normalized();
+		if(rotatino.IsNaN())
+		{
+			rotatino = JPH::Quat::sIdentity();
+		}
+		localTransform = JPH::Mat44::sRotation(rotatino.Normalized()) * localTransform;
+		localTransform.SetTranslation(JPH::Vec3(aPosition.position));
+		return localTransform;
+	}
+
 	const JPH::Mat44 ecs::Entity::GetTransform()
 	{
-		auto parent = GetComponent<Parent>();
+		auto [parent, scale, rotation, position] = GetComponents<const Parent, const Scale, const Rotation, const Position>();
+		const JPH::Mat44 localTransform = ComposeLocalTransform(*scale, *rotation, *position);
 		if (!parent)
 		{
-			return GetLocalTransform();
+			return localTransform;
 		}
 		else
 		{
-			return myWorld->GetEntity(parent->GetParent()).GetTransform() * GetLocalTransform();
+			return myWorld->GetEntity(parent->GetParent()).GetTransform() * localTransform;
 		}
 	}
 
 	const JPH::Mat44 ecs::Entity::GetLocalTransform()
 	{
-		JPH::Mat44 localTransform = JPH::Mat44::sIdentity();
-		localTransform.SetDiagonal3(JPH::Vec3(GetComponent<Scale>()->scale));
-		JPH::Quat rotatino = GetComponent<Rotation>()->rotation.Normalized();
-		if(rotatino.IsNaN())
-		{
-			rotatino = JPH::Quat::sIdentity();
-		}
-		localTransform = JPH::Mat44::sRotation(rotatino.Normalized()) * localTransform;
-		localTransform.SetTranslation(JPH::Vec3(GetComponent<Position>()->position));
-		return localTransform;
+		auto [scale, rotation, position] = GetComponents<const Scale, const Rotation, const Position>();
+		return ComposeLocalTransform(*scale, *rotation, *position);
 	}
 
 	void Entity::SetWorldTransform(const JPH::Mat44& aTransform)
 	{
-		auto parent = GetComponent<Parent>();
+		auto [parent, position, rotation] = GetComponents<const Parent, Position, Rotation>();
 		JPH::Mat44 localSpace = JPH::Mat44::sIdentity();
 		if (parent)
 		{
@@ -73,13 +80,13 @@ namespace ecs
 
 		auto localTrans = localSpace * aTransform;
 
-		GetComponent<Position>()->position = { localTrans.GetTranslation().GetX(), localTrans.GetTranslation().GetY(), localTrans.GetTranslation().GetZ() };
+		position->position = { localTrans.GetTranslation().GetX(), localTrans.GetTranslation().GetY(), localTrans.GetTranslation().GetZ() };
 
 		localTrans.SetAxisX(localTrans.GetAxisX().Normalized());
 		localTrans.SetAxisY(localTrans.GetAxisY().Normalized());
 		localTrans.SetAxisZ(localTrans.GetAxisZ().Normalized());
 
-		GetComponent<Rotation>()->rotation = localTrans.GetQuaternion();
+		rotation->rotation = localTrans.GetQuaternion();
 	}
 
 	JPH::Vec3 ecs::Entity::GetWorldPosition()
@@ -89,8 +96,7 @@ namespace ecs
 
 	JPH::Quat ecs::Entity::GetWorldRotation()
 	{
-		auto parent = GetComponent<Parent>();
-		auto localRot = GetComponent<Rotation>();
+		auto [parent, localRot] = GetComponents<const Parent, const Rotation>();
 		if (!parent)
 		{
 			return localRot->rotation;
@@ -101,8 +107,7 @@ namespace ecs
 
 	JPH::Vec3 ecs::Entity::GetWorldScale()
 	{
-		auto parent = GetComponent<Parent>();
-		auto scale = GetComponent<Scale>();
+		auto [parent, scale] = GetComponents<const Parent, const Scale>();
 		if (!parent)
 		{
 			return JPH::Vec3(scale->scale);
@@ -120,7 +125,7 @@ namespace ecs
 		os << "Archetype Components: " << "\n";
 		for (auto& type : archetype->GetType())
 		{
-			os << type.name() << "\n";
+			os << ComponentRegistry::GetName(type) << "\n";
 		}
 		os << "***********************************" << "\n";
 
@@ -63,6 +63,7 @@ namespace ecs {
 
 		/// <summary>
 		/// Retrieves a pointer to the component of the specified type attached to the entity.
+		/// Counts as a write for Changed<T> queries unless T is const.
 		/// </summary>
 		/// <typeparam name="T">The component type to retrieve.</typeparam>
 		/// <returns>
@@ -71,6 +72,33 @@ namespace ecs {
 		template<typename T>
 		inline T* GetComponent();
 
+		/// <summary>
+		/// Retrieves pointers to several components at once, the entity is only looked up once.
+		/// Counts as a write for Changed<T> queries to each of them that isn't const.
+		/// </summary>
+		/// <typeparam name="Components">The component types to retrieve.</typeparam>
+		/// <returns>
+		/// A tuple with a pointer per component type, `nullptr` for the ones the entity does not have.
+		/// </returns>
+		template<typename... Components>
+		inline std::tuple<Components*...> GetComponents();
+
+		/// <summary>
+		/// Enables or disables a component without moving the entity, queries skip the entity while a queried component is disabled.
+		/// </summary>
+		/// <typeparam name="T">The component type to enable or disable.</typeparam>
+		template<typename T>
+		inline void EnableComponent(bool aEnabled);
+
+		/// <summary>
+		/// Checks if the component of the specified type is enabled on the entity.
+		/// </summary>
+		/// <returns>
+		/// Returns `false` if the component is disabled or the entity does not have it.
+		/// </returns>
+		template<typename T>
+		inline bool IsComponentEnabled() const;
+
 		/// <summary>
 		/// Marks an Entity to survive reloading a scene, this adds a component to the the entity aswell as setting all its parents to dont destroy.
 		/// </summary>
@@ -147,4 +175,19 @@ namespace ecs {
 	T* Entity::GetComponent() {
 		return myWorld->GetComponent<T>(myID);
 	}
+
+	template<typename... Components>
+	std::tuple<Components*...> Entity::GetComponents() {
+		return myWorld->GetComponents<Components...>(myID);
+	}
+
+	template<typename T>
+	void Entity::EnableComponent(bool aEnabled) {
+		myWorld->EnableComponent<T>(myID, aEnabled);
+	}
+
+	template<typename T>
+	bool Entity::IsComponentEnabled() const {
+		return myWorld->IsComponentEnabled<T>(myID);
+	}
 }
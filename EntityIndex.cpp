@@ -0,0 +1,108 @@
+#include "EntityIndex.h"
+namespace ecs
+{
+	EntityIndex::EntityIndex(const allocator_type& aAllocator)
+		: mySlots(1, aAllocator), myFreeList(aAllocator)
+	{
+	}
+
+	EntityID EntityIndex::Generate()
+	{
+		if (!myFreeList.empty())
+		{
+			const uint32_t index = myFreeList.back();
+			RemoveFree(index);
+			return MakeEntityID(index, mySlots[index].generation);
+		}
+
+		assert(mySlots.size() < UINT32_MAX, "Out of entity slots");
+		const uint32_t index = static_cast<uint32_t>(mySlots.size());
+		mySlots.emplace_back();
+		return MakeEntityID(index, 0);
+	}
+
+	void EntityIndex::Emplace(EntityID aEntity, const Record& aRecord)
+	{
+		const uint32_t index = GetEntityIndex(aEntity);
+		assert(index != 0, "Cannot emplace the null entity");
+		if (mySlots.size() <= index)
+		{
+			//Slots skipped over are free to be handed out, the emplaced one is taken right away
+			const uint32_t firstNewIndex = static_cast<uint32_t>(mySlots.size());
+			mySlots.resize(static_cast<size_t>(index) + 1);
+			for (uint32_t skippedIndex = firstNewIndex; skippedIndex < index; skippedIndex++)
+			{
+				PushFree(skippedIndex);
+			}
+		}
+
+		Slot& slot = mySlots[index];
+		assert(slot.record.archetype == nullptr, "Emplacing over a live entity, its id was handed out twice");
+		if (slot.freeListPosition != NotFree)
+		{
+			RemoveFree(index);
+		}
+		slot.generation = GetEntityGeneration(aEntity);
+		slot.record = aRecord;
+	}
+
+	void EntityIndex::Erase(EntityID aEntity)
+	{
+		if (!Contains(aEntity)) return;
+		Release(GetEntityIndex(aEntity));
+	}
+
+	void EntityIndex::Clear()
+	{
+		myFreeList.clear();
+		for (uint32_t index = static_cast<uint32_t>(mySlots.size()) - 1; index > 0; index--)
+		{
+			Release(index);
+		}
+	}
+
+	void EntityIndex::Reserve(size_t aCount)
+	{
+		if (aCount <= myFreeList.size()) return;
+		mySlots.reserve(mySlots.size() + aCount - myFreeList.size());
+	}
+
+	size_t EntityIndex::GetNumSlots() const
+	{
+		return mySlots.size() - 1;
+	}
+
+	size_t EntityIndex::GetNumFreeSlots() const
+	{
+		return myFreeList.size();
+	}
+
+	void EntityIndex::Release(uint32_t aIndex)
+	{
+		Slot& slot = mySlots[aIndex];
+		slot.record = Record{ nullptr, 0 };
+		slot.freeListPosition = NotFree;
+
+		//A slot whose generation would wrap is retired instead, an old handle could otherwise match again.
+		if (slot.generation == UINT32_MAX) return;
+		slot.generation++;
+		PushFree(aIndex);
+	}
+
+	void EntityIndex::PushFree(uint32_t aIndex)
+	{
+		mySlots[aIndex].freeListPosition = static_cast<uint32_t>(myFreeList.size());
+		myFreeList.push_back(aIndex);
+	}
+
+	void EntityIndex::RemoveFree(uint32_t aIndex)
+	{
+		//Swapped with the last entry, the order of the free list doesn't matter
+		const uint32_t position = mySlots[aIndex].freeListPosition;
+		const uint32_t lastIndex = myFreeList.back();
+		myFreeList[position] = lastIndex;
+		mySlots[lastIndex].freeListPosition = position;
+		myFreeList.pop_back();
+		mySlots[aIndex].freeListPosition = NotFree;
+	}
+}
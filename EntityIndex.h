@@ -0,0 +1,115 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "Ecs_Aliases.h"
+#include "Archetype.h"
+namespace ecs
+{
+	//An EntityID is a 32 bit slot index in the low half and a 32 bit generation in the high half.
+	//Slot 0 is never handed out so ECS_ENTITY_NULL stays 0.
+	constexpr uint32_t GetEntityIndex(EntityID aEntity)
+	{
+		return static_cast<uint32_t>(aEntity & 0xFFFFFFFFull);
+	}
+
+	constexpr uint32_t GetEntityGeneration(EntityID aEntity)
+	{
+		return static_cast<uint32_t>(aEntity >> 32);
+	}
+
+	constexpr EntityID MakeEntityID(uint32_t aIndex, uint32_t aGeneration)
+	{
+		return (static_cast<EntityID>(aGeneration) << 32) | aIndex;
+	}
+
+	/// <summary>
+	/// Generational slot map from entity to its archetype and row.
+	/// Lookups are a bounds check and a generation compare, destroyed slots are recycled through a free list
+	/// and handles to a destroyed entity stop resolving because the slot generation has moved on.
+	/// </summary>
+	class EntityIndex
+	{
+	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
+		explicit EntityIndex(const allocator_type& aAllocator = {});
+
+		/// <summary>
+		/// Hands out a free slot. The slot is reserved but not alive until Emplace is called for it.
+		/// </summary>
+		EntityID		Generate();
+
+		/// <summary>
+		/// Makes aEntity alive. Ids reserved by another index, like the world that owns a stage, are accepted as well,
+		/// their slot is taken off the free list so it is never handed out twice. The slot must not hold a live entity.
+		/// </summary>
+		void			Emplace(EntityID aEntity, const Record& aRecord);
+
+		/// <summary>
+		/// Kills aEntity and recycles its slot, every handle to it becomes stale.
+		/// </summary>
+		void			Erase(EntityID aEntity);
+
+		/// <summary>
+		/// Kills every entity and recycles every slot.
+		/// </summary>
+		void			Clear();
+
+		/// <summary>
+		/// Makes room for aCount more entities so generating them doesn't grow the slot list.
+		/// </summary>
+		void			Reserve(size_t aCount);
+
+		bool			Contains(EntityID aEntity) const;
+		Record&			At(EntityID aEntity);
+		const Record&	At(EntityID aEntity) const;
+		Record*			Find(EntityID aEntity);
+		size_t			GetNumSlots() const;
+		size_t			GetNumFreeSlots() const;
+
+	private:
+		static constexpr uint32_t NotFree = UINT32_MAX;
+
+		struct Slot
+		{
+			Record record{ nullptr, 0 };
+			uint32_t generation = 0;
+			uint32_t freeListPosition = NotFree; //Where the slot is in myFreeList, so Emplace can take it off without searching
+		};
+
+		std::pmr::vector<Slot> mySlots; //Indexed by GetEntityIndex(entity)
+		std::pmr::vector<uint32_t> myFreeList; //Slots that can be handed out again, reused last in first out
+
+		void			Release(uint32_t aIndex);
+		void			PushFree(uint32_t aIndex);
+		void			RemoveFree(uint32_t aIndex);
+	};
+
+	inline bool EntityIndex::Contains(EntityID aEntity) const
+	{
+		const uint32_t index = GetEntityIndex(aEntity);
+		return index != 0 && index < mySlots.size()
+			&& mySlots[index].generation == GetEntityGeneration(aEntity)
+			&& mySlots[index].record.archetype != nullptr;
+	}
+
+	inline Record& EntityIndex::At(EntityID aEntity)
+	{
+		assert(Contains(aEntity), "Entity is dead or was never created");
+		return mySlots[GetEntityIndex(aEntity)].record;
+	}
+
+	inline const Record& EntityIndex::At(EntityID aEntity) const
+	{
+		assert(Contains(aEntity), "Entity is dead or was never created");
+		return mySlots[GetEntityIndex(aEntity)].record;
+	}
+
+	inline Record* EntityIndex::Find(EntityID aEntity)
+	{
+		return Contains(aEntity) ? &mySlots[GetEntityIndex(aEntity)].record : nullptr;
+	}
+}
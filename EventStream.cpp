@@ -0,0 +1,59 @@
+#include "EventStream.h"
+namespace ecs
+{
+	EventStream::EventStream(const allocator_type& aAllocator)
+		: myEvents(aAllocator), myDispatching(aAllocator), mySubscribers(aAllocator)
+	{
+	}
+
+	EventStream::EventStream(EventStream&& aEventStream) noexcept
+		: EventStream(std::move(aEventStream), aEventStream.get_allocator())
+	{
+	}
+
+	EventStream::EventStream(EventStream&& aEventStream, const allocator_type& aAllocator)
+		: myEvents(std::move(aEventStream.myEvents), aAllocator), myDispatching(aAllocator),
+		mySubscribers(std::move(aEventStream.mySubscribers), aAllocator)
+	{
+	}
+
+	EventStream::allocator_type EventStream::get_allocator() const
+	{
+		return myEvents.get_allocator();
+	}
+
+	void EventStream::Subscribe(EventCallback&& aCallback)
+	{
+		mySubscribers.push_back(std::move(aCallback));
+	}
+
+	bool EventStream::HasSubscribers() const
+	{
+		return !mySubscribers.empty();
+	}
+
+	void EventStream::Record(EntityID aEntity)
+	{
+		myEvents.push_back(aEntity);
+	}
+
+	bool EventStream::HasEvents() const
+	{
+		return !myEvents.empty();
+	}
+
+	void EventStream::Dispatch()
+	{
+		myDispatching.swap(myEvents);
+		for (EventCallback& subscriber : mySubscribers)
+		{
+			subscriber(myDispatching);
+		}
+		myDispatching.clear();
+	}
+
+	void EventStream::ClearEvents()
+	{
+		myEvents.clear();
+	}
+}
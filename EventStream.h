@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include "Ecs_Aliases.h"
+namespace ecs
+{
+	using EventCallback = std::function<void(std::span<const EntityID>)>;
+
+	/// <summary>
+	/// Entities that one kind of event happened to for one component type, e.g. every entity that got Health set.
+	/// Events are recorded as they happen and every subscriber gets all of them in one call when the stream is dispatched.
+	/// </summary>
+	class EventStream
+	{
+	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
+		explicit EventStream(const allocator_type& aAllocator = {});
+		EventStream(EventStream&& aEventStream) noexcept;
+		EventStream(EventStream&& aEventStream, const allocator_type& aAllocator);
+		EventStream& operator=(EventStream&& aEventStream) = delete;
+
+		allocator_type	get_allocator() const;
+
+		void			Subscribe(EventCallback&& aCallback);
+		bool			HasSubscribers() const;
+
+		void			Record(EntityID aEntity);
+		bool			HasEvents() const;
+
+		/// <summary>
+		/// Hands the recorded events to every subscriber and clears them. Events recorded by the subscribers are kept for the next dispatch.
+		/// </summary>
+		void			Dispatch();
+
+		/// <summary>
+		/// Drops the recorded events without dispatching them.
+		/// </summary>
+		void			ClearEvents();
+
+	private:
+		std::pmr::vector<EntityID> myEvents; //Recorded since the last dispatch, in the order they happened
+		std::pmr::vector<EntityID> myDispatching; //Swapped with myEvents while dispatching so both keep their capacity
+		std::pmr::vector<EventCallback> mySubscribers;
+	};
+}
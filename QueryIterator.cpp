@@ -1,5 +1,6 @@
 #include "QueryIterator.h"
 #include "World/World.h"
+#include <bit>
 namespace ecs {
 	bool operator==(const QueryIterator& a, const QueryIterator& b)
 	{
@@ -15,36 +16,41 @@ namespace ecs {
 	Entity QueryIterator::operator*() const
 	{
 		return { 
-			myArchetypes.at(myArchetypeIndex)->GetEntityList().at(myEntityIndex), myWorld 
+			(*myArchetypes)[myArchetypeIndex]->GetEntityList().at(myEntityIndex), myWorld 
 		};
 	}
 
-	ecs::QueryIterator::QueryIterator(World* aWorld, std::vector<Archetype*> aArchetypeList)
-		: myArchetypes(std::move(aArchetypeList)), myArchetypeIndex(0), myEntityIndex(0), myWorld(aWorld)
+	ecs::QueryIterator::QueryIterator(World* aWorld, const std::pmr::vector<Archetype*>& aArchetypeList)
+		: myArchetypes(&aArchetypeList), myArchetypeIndex(0), myEntityIndex(0), myWorld(aWorld)
 	{
 		
 	}
 
-	ecs::QueryIterator::QueryIterator(std::vector<Archetype*> aArchetypeList, size_t aArchetypeIndex, size_t aEntityIndex, World* aWorld)
-		: myArchetypes(std::move(aArchetypeList)), myArchetypeIndex(aArchetypeIndex), myEntityIndex(aEntityIndex), myWorld(aWorld)
+	ecs::QueryIterator::QueryIterator(World* aWorld, const std::pmr::vector<Archetype*>& aArchetypeList, const ComponentMask& aRequired, const ComponentMask& aSparseRequired, const ComponentMask& aSparseExcluded,
+		const ComponentMask& aChanged, const ComponentMask& aAdded, ChangeTick aChangedSince, ChangeTick aRunTick)
+		: myArchetypes(&aArchetypeList), myArchetypeIndex(0), myEntityIndex(0), myWorld(aWorld), myRequired(aRequired),
+		mySparseRequired(aSparseRequired), mySparseExcluded(aSparseExcluded), myHasSparseFilter(aSparseRequired.any() || aSparseExcluded.any()),
+		myChanged(aChanged), myAdded(aAdded), myChangedSince(aChangedSince), myRunTick(aRunTick), myHasChangeFilter(aChanged.any() || aAdded.any())
 	{
-		
+
 	}
 
-	QueryIterator::QueryIterator(QueryIterator& aIterator) 
-		: myArchetypeIndex(aIterator.myArchetypeIndex), myEntityIndex(aIterator.myEntityIndex), myWorld(aIterator.myWorld)
+	ecs::QueryIterator::QueryIterator(const std::pmr::vector<Archetype*>& aArchetypeList, size_t aArchetypeIndex, size_t aEntityIndex, World* aWorld)
+		: myArchetypes(&aArchetypeList), myArchetypeIndex(aArchetypeIndex), myEntityIndex(aEntityIndex), myWorld(aWorld)
 	{
-			
+		
 	}
 
 	ecs::QueryIterator ecs::QueryIterator::operator++(int)
 	{
+		ClaimRowWrites();
 		myEntityIndex++;
-		if (myEntityIndex >= myArchetypes.at(myArchetypeIndex)->GetNumEntities())
+		if (myEntityIndex >= (*myArchetypes)[myArchetypeIndex]->GetNumEntities())
 		{
 			myArchetypeIndex++;
 			myEntityIndex = 0;
 		}
+		SkipFilteredRows();
 
 		return *this;
 	}
@@ -61,8 +67,10 @@ namespace ecs {
 
 	size_t QueryIterator::GetSize() const
 	{
+		if (!myArchetypes) return 0;
+
 		size_t size = 0;
-		for (auto x : myArchetypes) {
+		for (auto x : *myArchetypes) {
 			size += x->GetEntityList().size();
 		}
 		return size;
@@ -72,33 +80,87 @@ namespace ecs {
 
 	ecs::QueryIterator& ecs::QueryIterator::operator++()
 	{
+		ClaimRowWrites();
 		++myEntityIndex;
-		if (myEntityIndex >= myArchetypes.at(myArchetypeIndex)->GetNumEntities())
+		if (myEntityIndex >= (*myArchetypes)[myArchetypeIndex]->GetNumEntities())
 		{
 			myArchetypeIndex++;
 			myEntityIndex = 0;
 		}
+		SkipFilteredRows();
 		return *this;
 	}
 	
 	Entity QueryIterator::operator->()
 	{
-		return { myArchetypes.at(myArchetypeIndex)->GetEntityList().at(myEntityIndex), myWorld }; 
+		return { (*myArchetypes)[myArchetypeIndex]->GetEntityList().at(myEntityIndex), myWorld }; 
 	}
 
 	ecs::QueryIterator ecs::QueryIterator::begin()
 	{
-		return { myArchetypes,0,0,myWorld };
+		QueryIterator iterator(*this);
+		iterator.myArchetypeIndex = 0;
+		iterator.myEntityIndex = 0;
+		iterator.SkipFilteredRows();
+		return iterator;
+	}
+
+	void QueryIterator::SkipFilteredRows()
+	{
+		if (!myArchetypes) return;
+
+		while (myArchetypeIndex < myArchetypes->size())
+		{
+			Archetype* archetype = (*myArchetypes)[myArchetypeIndex];
+			const size_t numEntities = archetype->GetNumEntities();
+			//The newest ticks of the archetype tell if any row can pass the change filters before looking at a single row
+			if (myEntityIndex >= numEntities || (myEntityIndex == 0 && myHasChangeFilter && !archetype->HasChangesSince(myChanged, myAdded, myChangedSince)))
+			{
+				myArchetypeIndex++;
+				myEntityIndex = 0;
+				continue;
+			}
+
+			//Disabled components are scanned 64 rows at a time, a block with nothing enabled is skipped whole
+			if (archetype->HasDisabledComponents())
+			{
+				const uint64_t enabledRows = archetype->GetEnabledRows(myRequired, myEntityIndex >> 6) >> (myEntityIndex & 63);
+				if (enabledRows == 0)
+				{
+					myEntityIndex = (myEntityIndex | 63) + 1;
+					continue;
+				}
+				myEntityIndex += std::countr_zero(enabledRows);
+				if (myEntityIndex >= numEntities) continue;
+			}
+			else if (!myHasSparseFilter && !myHasChangeFilter)
+			{
+				return;
+			}
+
+			const bool matchesSparse = !myHasSparseFilter || myWorld->MatchesSparseComponents(archetype->GetEntity(myEntityIndex), mySparseRequired, mySparseExcluded);
+			if (matchesSparse && (!myHasChangeFilter || archetype->IsRowChangedSince(myChanged, myAdded, myEntityIndex, myChangedSince))) return;
+			myEntityIndex++;
+		}
+		myEntityIndex = 0;
+	}
+
+	//The loop body wrote the row it's leaving with the world tick, which is past the run tick and would show up in the next run
+	void QueryIterator::ClaimRowWrites()
+	{
+		if (!myHasChangeFilter || myChanged.none()) return;
+
+		(*myArchetypes)[myArchetypeIndex]->ClampChangedTicks(myChanged, myEntityIndex, myRunTick);
 	}
 
 	ecs::QueryIterator ecs::QueryIterator::end()
 	{
-		if (myArchetypes.size() < 1)
+		if (!myArchetypes)
 		{
-			return { myArchetypes,0,0,myWorld };
+			return QueryIterator();
 		}
 
-		return { myArchetypes,myArchetypes.size(),0,myWorld };
+		return { *myArchetypes,myArchetypes->size(),0,myWorld };
 
 	}
 
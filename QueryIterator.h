@@ -13,9 +13,12 @@ namespace ecs
 	public:
 		using iterator_category = std::forward_iterator_tag;
 		QueryIterator() = default;
-		QueryIterator(World* aWorld, std::vector<Archetype*> aArchetypeList);
-		QueryIterator(std::vector<Archetype*> aArchetypeList, size_t aArchetypeIndex, size_t aEntityIndex, World* aWorld);
-		QueryIterator(QueryIterator& aIterator);
+		QueryIterator(World* aWorld, const std::pmr::vector<Archetype*>& aArchetypeList);
+		QueryIterator(World* aWorld, const std::pmr::vector<Archetype*>& aArchetypeList, const ComponentMask& aRequired, const ComponentMask& aSparseRequired, const ComponentMask& aSparseExcluded,
+			const ComponentMask& aChanged = ComponentMask(), const ComponentMask& aAdded = ComponentMask(), ChangeTick aChangedSince = 0, ChangeTick aRunTick = 0);
+		QueryIterator(const std::pmr::vector<Archetype*>& aArchetypeList, size_t aArchetypeIndex, size_t aEntityIndex, World* aWorld);
+		QueryIterator(const QueryIterator& aIterator) = default;
+		QueryIterator& operator=(const QueryIterator& aIterator) = default;
 		
 
 		Entity operator*() const;
@@ -34,11 +37,22 @@ namespace ecs
 		size_t GetEntityIndex() const; 
 		size_t GetSize() const;
 	private:
-		std::vector<Archetype*> myArchetypes {};
+		const std::pmr::vector<Archetype*>* myArchetypes {nullptr}; //The query cache list owned by the world, shared by every iterator over it and never copied
 		size_t myArchetypeIndex{};
 		size_t myEntityIndex{};
 		World* myWorld {nullptr};
+		ComponentMask myRequired {}; //Rows where one of these components is disabled are skipped
+		ComponentMask mySparseRequired {}; //Sparse components aren't in the archetypes so rows are filtered on these while iterating
+		ComponentMask mySparseExcluded {};
+		bool myHasSparseFilter {false};
+		ComponentMask myChanged {}; //Rows are skipped unless these were written to after myChangedSince
+		ComponentMask myAdded {}; //Rows are skipped unless these were added after myChangedSince
+		ChangeTick myChangedSince {0};
+		ChangeTick myRunTick {0}; //Tick reserved for this run, writes to myChanged of the row the loop leaves are stamped with it so the next run doesn't see them
+		bool myHasChangeFilter {false};
 
+		void SkipFilteredRows();
+		void ClaimRowWrites();
 	};
 
 
@@ -0,0 +1,319 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "Ecs_Aliases.h"
+#include "ComponentRegistry.h"
+namespace ecs
+{
+	/// <summary>
+	/// Query term matching entities whose T was written to since the query last ran, e.g. world.Query<Position, Changed<Velocity>>().
+	/// Writes are mutable access through GetComponent, Set, Each and ForEachChunk, adding T counts as a write as well.
+	/// Each hands it out as a T& like a plain component.
+	/// </summary>
+	template<typename T>
+	struct Changed {};
+
+	/// <summary>
+	/// Query term matching entities that got T since the query last ran.
+	/// </summary>
+	template<typename T>
+	struct Added {};
+
+	/// <summary>
+	/// Query term requiring every one of Ts without handing them to Each, e.g. world.Each<Position, With<Player>>(...).
+	/// </summary>
+	template<typename... Ts>
+	struct With {};
+
+	/// <summary>
+	/// Query term leaving out entities that have any of Ts.
+	/// </summary>
+	template<typename... Ts>
+	struct Without {};
+
+	/// <summary>
+	/// Query term that matches with or without T. Each hands it out as a T* that is nullptr for entities without it,
+	/// the column is looked up once per archetype.
+	/// </summary>
+	template<typename T>
+	struct Optional {};
+
+	/// <summary>
+	/// Query term matching entities that have at least one of Ts.
+	/// </summary>
+	template<typename... Ts>
+	struct AnyOf {};
+
+	/// <summary>
+	/// Query term matching entities that have exactly one of Ts.
+	/// </summary>
+	template<typename... Ts>
+	struct OneOf {};
+
+	//A query compiled to component masks, built once from the template arguments of the query.
+	//An archetype matches when its signature has every required component, none of the excluded ones,
+	//at least one component of every AnyOf group and exactly one of every OneOf group.
+	struct QueryTerms
+	{
+		static constexpr size_t MaxGroups = 4; //AnyOf and OneOf terms one query can have of each
+
+		ComponentMask required;
+		ComponentMask excluded;
+		ComponentMask optional; //Only decides what Each hands out, never filters
+		ComponentMask changed; //Also set in required
+		ComponentMask added; //Also set in required
+		std::array<ComponentMask, MaxGroups> anyOf{};
+		std::array<ComponentMask, MaxGroups> oneOf{};
+		uint8_t numAnyOf = 0;
+		uint8_t numOneOf = 0;
+
+		bool HasChangeFilter() const { return changed.any() || added.any(); }
+
+		bool MatchesGroups(const ComponentMask& aSignature) const
+		{
+			for (size_t i = 0; i < numAnyOf; i++)
+			{
+				if ((aSignature & anyOf[i]).none()) return false;
+			}
+			for (size_t i = 0; i < numOneOf; i++)
+			{
+				if ((aSignature & oneOf[i]).count() != 1) return false;
+			}
+			return true;
+		}
+
+		//Components that are matched or handed out per archetype, these can't be sparse
+		ComponentMask GetGroupComponents() const
+		{
+			ComponentMask components = optional;
+			for (size_t i = 0; i < numAnyOf; i++) components |= anyOf[i];
+			for (size_t i = 0; i < numOneOf; i++) components |= oneOf[i];
+			return components;
+		}
+
+		size_t GetHash() const
+		{
+			const std::hash<ComponentMask> hasher;
+			size_t hash = hasher(required);
+			auto combine = [&](const ComponentMask& aMask) { hash ^= hasher(aMask) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+			combine(excluded);
+			combine(changed);
+			combine(added);
+			for (size_t i = 0; i < numAnyOf; i++) combine(anyOf[i]);
+			for (size_t i = 0; i < numOneOf; i++) combine(oneOf[i]);
+			return hash;
+		}
+
+		friend bool operator==(const QueryTerms& aLeft, const QueryTerms& aRight) = default;
+	};
+
+	//How each kind of term adds itself to QueryTerms. Argument is what Each hands the function for the term, nothing for pure filters,
+	//and Component is the type whose column Each looks up, void when there is none.
+	template<typename T>
+	struct QueryTerm
+	{
+		using Argument = std::tuple<T&>;
+		using Component = T;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms) { aTerms.required.set(GetComponentID<T>()); }
+	};
+
+	template<typename T>
+	struct QueryTerm<Changed<T>>
+	{
+		using Argument = std::tuple<T&>;
+		using Component = T;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms)
+		{
+			aTerms.required.set(GetComponentID<T>());
+			aTerms.changed.set(GetComponentID<T>());
+		}
+	};
+
+	template<typename T>
+	struct QueryTerm<Added<T>>
+	{
+		using Argument = std::tuple<T&>;
+		using Component = T;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms)
+		{
+			aTerms.required.set(GetComponentID<T>());
+			aTerms.added.set(GetComponentID<T>());
+		}
+	};
+
+	template<typename... Ts>
+	struct QueryTerm<With<Ts...>>
+	{
+		using Argument = std::tuple<>;
+		using Component = void;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms) { (aTerms.required.set(GetComponentID<Ts>()), ...); }
+	};
+
+	template<typename... Ts>
+	struct QueryTerm<Without<Ts...>>
+	{
+		using Argument = std::tuple<>;
+		using Component = void;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms) { (aTerms.excluded.set(GetComponentID<Ts>()), ...); }
+	};
+
+	template<typename T>
+	struct QueryTerm<Optional<T>>
+	{
+		static_assert(!std::is_empty_v<T>, "Tags have no data to hand out, use AnyOf or HasComponent");
+		using Argument = std::tuple<T*>;
+		using Component = T;
+		static constexpr bool isOptional = true;
+		static void Apply(QueryTerms& aTerms) { aTerms.optional.set(GetComponentID<T>()); }
+	};
+
+	template<typename... Ts>
+	struct QueryTerm<AnyOf<Ts...>>
+	{
+		using Argument = std::tuple<>;
+		using Component = void;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms)
+		{
+			assert(aTerms.numAnyOf < QueryTerms::MaxGroups, "Too many AnyOf terms in one query");
+			(aTerms.anyOf[aTerms.numAnyOf].set(GetComponentID<Ts>()), ...);
+			aTerms.numAnyOf++;
+		}
+	};
+
+	template<typename... Ts>
+	struct QueryTerm<OneOf<Ts...>>
+	{
+		using Argument = std::tuple<>;
+		using Component = void;
+		static constexpr bool isOptional = false;
+		static void Apply(QueryTerms& aTerms)
+		{
+			assert(aTerms.numOneOf < QueryTerms::MaxGroups, "Too many OneOf terms in one query");
+			(aTerms.oneOf[aTerms.numOneOf].set(GetComponentID<Ts>()), ...);
+			aTerms.numOneOf++;
+		}
+	};
+
+	template<typename... Terms>
+	inline QueryTerms MakeQueryTerms()
+	{
+		QueryTerms terms;
+		(QueryTerm<Terms>::Apply(terms), ...);
+		return terms;
+	}
+
+	//Component the term looks up a column for, ECS_COMPONENT_NULL for pure filters
+	template<typename Term>
+	inline ComponentID GetTermComponentID()
+	{
+		using T = typename QueryTerm<Term>::Component;
+		if constexpr (std::is_void_v<T>) return ECS_COMPONENT_NULL;
+		else return GetComponentID<T>();
+	}
+
+	//Whether Each hands the term out as mutable, visiting a row then counts as a write
+	template<typename Term>
+	inline constexpr bool isMutableTerm = !std::is_void_v<typename QueryTerm<Term>::Component>
+		&& !std::is_const_v<typename QueryTerm<Term>::Component> && !std::is_empty_v<typename QueryTerm<Term>::Component>;
+
+	//Arguments Each calls its function with for a list of terms
+	template<typename... Terms>
+	using EachArguments = decltype(std::tuple_cat(std::declval<typename QueryTerm<Terms>::Argument>()...));
+
+	template<typename Function, typename Arguments>
+	struct IsInvocableWith;
+
+	template<typename Function, typename... Arguments>
+	struct IsInvocableWith<Function, std::tuple<Arguments...>> : std::is_invocable<Function, Arguments...> {};
+
+	//Parameter types of a function pointer or of a type with a single call operator. Generic lambdas and overload sets are unknown,
+	//their parameters can only be found by calling them.
+	template<typename Function, typename = void>
+	struct CallParameters
+	{
+		static constexpr bool isKnown = false;
+		using Types = std::tuple<>;
+	};
+
+	template<typename Function>
+	struct CallParameters<Function, std::void_t<decltype(&Function::operator())>> : CallParameters<decltype(&Function::operator())> {};
+
+	template<typename Result, typename... Parameters>
+	struct CallParameters<Result(*)(Parameters...), void>
+	{
+		static constexpr bool isKnown = true;
+		using Types = std::tuple<Parameters...>;
+	};
+
+	template<typename Result, typename... Parameters>
+	struct CallParameters<Result(*)(Parameters...) noexcept, void> : CallParameters<Result(*)(Parameters...)> {};
+
+	template<typename Result, typename Class, typename... Parameters>
+	struct CallParameters<Result(Class::*)(Parameters...), void> : CallParameters<Result(*)(Parameters...)> {};
+
+	template<typename Result, typename Class, typename... Parameters>
+	struct CallParameters<Result(Class::*)(Parameters...) const, void> : CallParameters<Result(*)(Parameters...)> {};
+
+	template<typename Result, typename Class, typename... Parameters>
+	struct CallParameters<Result(Class::*)(Parameters...) noexcept, void> : CallParameters<Result(*)(Parameters...)> {};
+
+	template<typename Result, typename Class, typename... Parameters>
+	struct CallParameters<Result(Class::*)(Parameters...) const noexcept, void> : CallParameters<Result(*)(Parameters...)> {};
+
+	//Whether a parameter lets the function write the component, a non-const reference, pointer or span
+	template<typename Parameter, typename = void>
+	inline constexpr bool isWritableParameter = (std::is_lvalue_reference_v<Parameter> && !std::is_const_v<std::remove_reference_t<Parameter>>)
+		|| (std::is_pointer_v<Parameter> && !std::is_const_v<std::remove_pointer_t<Parameter>>);
+
+	template<typename Parameter>
+	inline constexpr bool isWritableParameter<Parameter, std::void_t<typename std::remove_cvref_t<Parameter>::element_type>> =
+		!std::is_const_v<typename std::remove_cvref_t<Parameter>::element_type>;
+
+	//For every argument Each hands out for the terms, whether the term is mutable
+	template<typename... Terms>
+	constexpr auto GetArgumentWriteFlags()
+	{
+		std::array<bool, std::tuple_size_v<EachArguments<Terms...>>> flags{};
+		size_t argument = 0;
+		((std::tuple_size_v<typename QueryTerm<Terms>::Argument> != 0 ? (void)(flags[argument++] = isMutableTerm<Terms>) : (void)0), ...);
+		return flags;
+	}
+
+	/// <summary>
+	/// False when Function takes a term that isn't const by const reference, const pointer, const span or by value.
+	/// Every row Each visits counts as a write to the mutable terms, so a term that is only read should be declared const instead.
+	/// Functions whose parameters are unknown, like generic lambdas, always pass.
+	/// </summary>
+	template<typename Function, typename... Terms>
+	constexpr bool TakesMutableTermsWritable()
+	{
+		using Parameters = CallParameters<std::remove_cvref_t<Function>>;
+		constexpr auto flags = GetArgumentWriteFlags<Terms...>();
+		constexpr size_t numParameters = std::tuple_size_v<typename Parameters::Types>;
+		if constexpr (!Parameters::isKnown || (numParameters != flags.size() && numParameters != flags.size() + 1))
+		{
+			return true;
+		}
+		else
+		{
+			//A leading parameter is the EntityID or the span of entities
+			constexpr size_t offset = numParameters - flags.size();
+			return[&]<size_t... I>(std::index_sequence<I...>)
+			{
+				return ((!flags[I] || isWritableParameter<std::tuple_element_t<I + offset, typename Parameters::Types>>) && ...);
+			}(std::make_index_sequence<flags.size()>{});
+		}
+	}
+}
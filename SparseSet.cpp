@@ -0,0 +1,202 @@
+#include "SparseSet.h"
+#include <algorithm>
+#include <cstring>
+namespace ecs
+{
+	SparseSet::SparseSet(const allocator_type& aAllocator)
+		: mySparse(aAllocator), myDense(aAllocator), myPages(aAllocator)
+	{
+	}
+
+	SparseSet::SparseSet(SparseSet&& aSparseSet) noexcept
+		: SparseSet(std::move(aSparseSet), aSparseSet.get_allocator())
+	{
+	}
+
+	SparseSet::SparseSet(SparseSet&& aSparseSet, const allocator_type& aAllocator)
+		: SparseSet(aAllocator)
+	{
+		SetTypeInfo(aSparseSet.myTypeInfo);
+		aSparseSet.MoveTo(*this);
+	}
+
+	SparseSet::~SparseSet()
+	{
+		Clear();
+	}
+
+	SparseSet::allocator_type SparseSet::get_allocator() const
+	{
+		return myDense.get_allocator();
+	}
+
+	void SparseSet::SetTypeInfo(const ComponentTypeInfo& aTypeInfo)
+	{
+		assert(myDense.empty(), "Cannot change the type of a sparse set that holds components");
+		myTypeInfo = aTypeInfo;
+
+		//Same sizing as an archetype chunk with a single column
+		myPageShift = 0;
+		myPageBytes = 0;
+		myPageAlignment = std::max(ECS_COLUMN_ALIGNMENT, myTypeInfo.alignment);
+		if (myTypeInfo.isTag || myTypeInfo.size == 0) return;
+
+		while (myTypeInfo.size * (size_t(2) << myPageShift) <= ECS_CHUNK_SIZE)
+		{
+			myPageShift++;
+		}
+		myPageBytes = myTypeInfo.size << myPageShift;
+	}
+
+	const ComponentTypeInfo& SparseSet::GetTypeInfo() const
+	{
+		return myTypeInfo;
+	}
+
+	bool SparseSet::Contains(EntityID aEntity) const
+	{
+		const uint32_t index = GetEntityIndex(aEntity);
+		return index < mySparse.size() && mySparse[index] != NullSlot && myDense[mySparse[index]] == aEntity;
+	}
+
+	void* SparseSet::Emplace(EntityID aEntity)
+	{
+		if (Contains(aEntity)) return Get(aEntity);
+
+		const uint32_t index = GetEntityIndex(aEntity);
+		if (mySparse.size() <= index)
+		{
+			mySparse.resize(static_cast<size_t>(index) + 1, NullSlot);
+		}
+
+		const size_t denseIndex = myDense.size();
+		mySparse[index] = static_cast<uint32_t>(denseIndex);
+		myDense.push_back(aEntity);
+		if (myPageBytes == 0) return nullptr;
+
+		if ((denseIndex >> myPageShift) >= myPages.size())
+		{
+			AddPage();
+		}
+
+		void* element = GetData(denseIndex);
+		if (myTypeInfo.construct)
+		{
+			myTypeInfo.construct(element);
+		}
+		else
+		{
+			std::memset(element, 0, myTypeInfo.size);
+		}
+		return element;
+	}
+
+	void* SparseSet::Get(EntityID aEntity)
+	{
+		if (myPageBytes == 0 || !Contains(aEntity)) return nullptr;
+		return GetData(mySparse[GetEntityIndex(aEntity)]);
+	}
+
+	bool SparseSet::Erase(EntityID aEntity)
+	{
+		if (!Contains(aEntity)) return false;
+
+		const uint32_t denseIndex = mySparse[GetEntityIndex(aEntity)];
+		const size_t lastIndex = myDense.size() - 1;
+
+		if (myPageBytes != 0)
+		{
+			void* element = GetData(denseIndex);
+			DestroyElement(element);
+			if (denseIndex != lastIndex)
+			{
+				void* last = GetData(lastIndex);
+				MoveElement(element, last);
+				DestroyElement(last);
+			}
+		}
+
+		const EntityID lastEntity = myDense[lastIndex];
+		myDense[denseIndex] = lastEntity;
+		mySparse[GetEntityIndex(lastEntity)] = denseIndex;
+		mySparse[GetEntityIndex(aEntity)] = NullSlot;
+		myDense.pop_back();
+		return true;
+	}
+
+	void SparseSet::MoveTo(SparseSet& aTarget)
+	{
+		for (size_t i = 0; i < myDense.size(); i++)
+		{
+			const EntityID entity = myDense[i];
+			aTarget.Erase(entity);
+			void* target = aTarget.Emplace(entity);
+			if (myPageBytes == 0) continue;
+
+			void* source = GetData(i);
+			aTarget.DestroyElement(target);
+			MoveElement(target, source);
+		}
+		Clear();
+	}
+
+	void SparseSet::Clear()
+	{
+		if (myPageBytes != 0 && !myTypeInfo.isTrivial)
+		{
+			for (size_t i = 0; i < myDense.size(); i++)
+			{
+				DestroyElement(GetData(i));
+			}
+		}
+		myDense.clear();
+		mySparse.clear();
+		myPages.clear();
+	}
+
+	size_t SparseSet::GetSize() const
+	{
+		return myDense.size();
+	}
+
+	const std::pmr::vector<EntityID>& SparseSet::GetEntities() const
+	{
+		return myDense;
+	}
+
+	void* SparseSet::GetData(size_t aDenseIndex)
+	{
+		return myPages[aDenseIndex >> myPageShift].get() + (aDenseIndex & ((size_t(1) << myPageShift) - 1)) * myTypeInfo.size;
+	}
+
+	void SparseSet::AddPage()
+	{
+		std::pmr::memory_resource* resource = get_allocator().resource();
+		std::byte* page = static_cast<std::byte*>(resource->allocate(myPageBytes, myPageAlignment));
+		myPages.emplace_back(page, ChunkDeleter{ resource, myPageBytes, myPageAlignment });
+	}
+
+	void SparseSet::MoveElement(void* aTo, void* aFrom)
+	{
+		if (myTypeInfo.isTrivial)
+		{
+			std::memcpy(aTo, aFrom, myTypeInfo.size);
+		}
+		else if (myTypeInfo.move)
+		{
+			myTypeInfo.move(aTo, aFrom);
+		}
+		else
+		{
+			myTypeInfo.copy(aTo, aFrom);
+		}
+	}
+
+	void SparseSet::DestroyElement(void* aElement)
+	{
+		if (!myTypeInfo.isTrivial && myTypeInfo.destruct)
+		{
+			myTypeInfo.destruct(aElement);
+		}
+	}
+}
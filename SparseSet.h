@@ -0,0 +1,73 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "Ecs_Aliases.h"
+#include "ComponentRegistry.h"
+#include "Archetype.h"
+#include "EntityIndex.h"
+namespace ecs
+{
+	/// <summary>
+	/// Component storage that lives outside the archetype table, for components that are added and removed often.
+	/// Entities are packed in a dense list with their component data beside them in fixed size pages,
+	/// the sparse list maps an entity index to its place in the dense list. Adding and removing never moves the entity between archetypes.
+	/// </summary>
+	class SparseSet
+	{
+	public:
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
+		explicit SparseSet(const allocator_type& aAllocator = {});
+		SparseSet(SparseSet&& aSparseSet) noexcept;
+		SparseSet(SparseSet&& aSparseSet, const allocator_type& aAllocator);
+		SparseSet& operator=(SparseSet&& aSparseSet) = delete;
+		~SparseSet();
+
+		allocator_type	get_allocator() const;
+
+		void			SetTypeInfo(const ComponentTypeInfo& aTypeInfo);
+		const ComponentTypeInfo& GetTypeInfo() const;
+
+		bool			Contains(EntityID aEntity) const;
+
+		/// <summary>
+		/// Default constructs the component for aEntity, returns the existing one if the entity already has it. Tags return nullptr.
+		/// </summary>
+		void*			Emplace(EntityID aEntity);
+		void*			Get(EntityID aEntity);
+
+		/// <summary>
+		/// Destroys the component of aEntity, the last element is moved into the hole.
+		/// </summary>
+		bool			Erase(EntityID aEntity);
+
+		/// <summary>
+		/// Moves every element into aTarget, leaving this set empty. Entities aTarget already has are overwritten.
+		/// </summary>
+		void			MoveTo(SparseSet& aTarget);
+		void			Clear();
+
+		size_t			GetSize() const;
+		const std::pmr::vector<EntityID>& GetEntities() const;
+		void*			GetData(size_t aDenseIndex);
+
+	private:
+		static constexpr uint32_t NullSlot = UINT32_MAX;
+
+		ComponentTypeInfo myTypeInfo;
+		std::pmr::vector<uint32_t> mySparse; //Indexed by entity index, position in the dense list or NullSlot
+		std::pmr::vector<EntityID> myDense; //Entities that have the component, packed
+		std::pmr::vector<ChunkPtr> myPages; //Component data in dense order, pages never move so pointers stay valid until the element is erased
+		size_t myPageShift = 0;
+		size_t myPageBytes = 0;
+		size_t myPageAlignment = ECS_COLUMN_ALIGNMENT;
+
+		void			AddPage();
+		void			MoveElement(void* aTo, void* aFrom);
+		void			DestroyElement(void* aElement);
+	};
+}
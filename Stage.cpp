@@ -4,8 +4,9 @@
 
 namespace ecs
 {
-	ecs::Stage::Stage(World* aWorld) : myWorld(aWorld)
+	ecs::Stage::Stage(World* aWorld, std::pmr::memory_resource* aMemoryResource) : World(aMemoryResource), myWorld(aWorld)
 	{
+		myIDSource = aWorld;
 	}
 	ecs::Stage::~Stage()
 	{
@@ -30,9 +31,11 @@ namespace ecs
 				for(auto e : list)
 				{
 
-					myWorld->myEntityIndex.emplace(e,Record(&targetArchetype,myEntityIndex.at(e).row));
+					myWorld->myEntityIndex.Emplace(e,Record(&targetArchetype,myEntityIndex.At(e).row));
 				}
 				targetArchetype.Reset(sourceArchetype);
+				targetArchetype.SetRowsAdded(0, targetArchetype.GetNumEntities(), myWorld->GetChangeTick());
+				myWorld->RecordRowEvents(targetArchetype, 0, targetArchetype.GetNumEntities(), ObserverType::OnAdd);
 			}
 			else
 			{
@@ -41,6 +44,10 @@ namespace ecs
 				auto& newSource = myWorld->myArchetypeIndex.at(type);
 				newSource = std::move(sourceArchetype);
 				newSource.SetID(myWorld->GenerateArchetypeID());
+				newSource.ClearEdges(); //Edges still point into the stage
+				myWorld->RegisterArchetype(newSource);
+				newSource.SetRowsAdded(0, newSource.GetNumEntities(), myWorld->GetChangeTick()); //Ticks of the stage mean nothing to the world
+				myWorld->RecordRowEvents(newSource, 0, newSource.GetNumEntities(), ObserverType::OnAdd);
 				auto& list = newSource.GetEntityList();
 
 				for(const auto& comp : type)
@@ -52,12 +59,23 @@ namespace ecs
 
 				for(auto e : list)
 				{
-					myWorld->myEntityIndex.emplace(e,Record(&newSource,myEntityIndex.at(e).row));
+					myWorld->myEntityIndex.Emplace(e,Record(&newSource,myEntityIndex.At(e).row));
 				}
 				
 				//myWorld->myComponentIndex.
 			}
 		}
+
+		for (ComponentID componentID = 0; componentID < mySparseSets.size(); componentID++)
+		{
+			if (!IsSparseComponent(componentID)) continue;
+			myWorld->RegisterSparseComponent(componentID);
+			for (EntityID entity : mySparseSets[componentID].GetEntities())
+			{
+				myWorld->RecordEvent(componentID, ObserverType::OnAdd, entity);
+			}
+			mySparseSets[componentID].MoveTo(myWorld->mySparseSets[componentID]);
+		}
 		
 
 	}
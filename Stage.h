@@ -8,7 +8,7 @@ namespace ecs
 	{
 	public:
 		friend World;
-		Stage(World* aWorld);
+		Stage(World* aWorld, std::pmr::memory_resource* aMemoryResource = std::pmr::get_default_resource());
 		~Stage();
 		
 		Entity CreateEntity();
@@ -15,37 +15,46 @@ bool ecs::SystemManager::Progress()
 	if (!myIsStarted)
 	{
 		OnStart();
+		Sync();
 		myIsStarted = true;
 	}
 #ifndef _RETAIL
 	if (!myDebugIsStarted)
 	{
 		DebugOnStart();
+		Sync();
 		myDebugIsStarted = true;
 	}
 #endif
 
 
 		OnLoad();
+		Sync();
 
 
 		PostLoad();
+		Sync();
 
 
 #ifndef _RETAIL
 	DebugPreUpdate();
+	Sync();
 	DebugOnUpdate();
+	Sync();
 #endif
 	/*while (myTimer.ShouldRunFixed())
 	{*/
 
 
 		PreUpdate();
+		Sync();
 
 		OnUpdate();
+		Sync();
 
 
 		OnValidate();
+		Sync();
 
 
 		//myTimer.FixedTick();
@@ -55,25 +64,33 @@ bool ecs::SystemManager::Progress()
 
 
 	OnRenderLoad();
+	Sync();
 
 
 	PostRenderLoad();
+	Sync();
 
 
 	PreRender();
+	Sync();
 
 
 	Render();
+	Sync();
 
 
 	UIRender();
+	Sync();
 
 
 #ifndef _RETAIL
 	DebugRender();
+	Sync();
 	DebugPostRender();
+	Sync();
 #endif
 	PostRender();
+	Sync();
 
 
 	RemoveSystems();
@@ -85,6 +102,7 @@ bool ecs::SystemManager::Progress()
 	if (myShouldQuit)
 	{
 		PreQuit();
+		Sync();
 		OnQuit();
 		return false;
 	}
@@ -115,6 +133,20 @@ void ecs::SystemManager::Quit()
 	myShouldQuit = true;
 }
 
+void ecs::SystemManager::SetSyncPoint(std::function<void()> aSyncPoint)
+{
+	mySyncPoint = std::move(aSyncPoint);
+}
+
+void ecs::SystemManager::Sync()
+{
+	if (!mySyncPoint) return;
+
+	PIXBeginEvent(190, "SyncPoint");
+	mySyncPoint();
+	PIXEndEvent();
+}
+
 void ecs::SystemManager::DebugOnUpdate()
 {
 	PIXBeginEvent(0, "DebugOnUpdate");
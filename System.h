@@ -50,6 +50,7 @@ namespace ecs {
 		void AddSystem(const System&& aSystem, const char* aName, Pipeline aPipeline = Pipeline::OnUpdate);
 		void RemoveSystem(const char* aName, Pipeline aPipeline);
 		void Quit();
+		void SetSyncPoint(std::function<void()> aSyncPoint);
 		float DeltaTime() const;
 		float FixedTime() const;
 		float TotalTime() const;
@@ -71,6 +72,7 @@ namespace ecs {
 		void PreQuit();
 		void OnQuit();
 		void RemoveSystems();
+		void Sync();
 
 		void DebugOnUpdate();
 		void DebugPreUpdate();
@@ -80,6 +82,7 @@ namespace ecs {
 		std::unordered_map<std::pair<std::string, Pipeline>, size_t, PairHash> mySystemIndex;
 		std::vector<std::pair<std::string, ecs::Pipeline>> mySystemsToRemoveThisFrame;
 		WorldTimer myTimer;
+		std::function<void()> mySyncPoint; //Runs after every phase, the world plays back its command buffers here
 		bool myShouldQuit = false;
 		bool myIsStarted = false;
 #ifndef _RETAIL
@@ -0,0 +1,113 @@
+#include "World/World.h"
+#include <cstdio>
+#include <memory_resource>
+#include <span>
+#include <tuple>
+
+//Small checks for behaviour that is easy to break without noticing, build with the engine and run the executable, it returns 0 when everything passes.
+
+using namespace ecs;
+
+namespace
+{
+	struct TestPosition { float x = 0, y = 0, z = 0; };
+	struct TestVelocity { float x = 0, y = 0, z = 0; };
+	struct TestDead {};
+
+	int ourNumFailed = 0;
+
+	//Counts the allocations a world makes from it
+	struct CountingResource : std::pmr::memory_resource
+	{
+		size_t numAllocations = 0;
+
+		void* do_allocate(size_t aBytes, size_t aAlignment) override
+		{
+			numAllocations++;
+			return std::pmr::new_delete_resource()->allocate(aBytes, aAlignment);
+		}
+		void do_deallocate(void* aPointer, size_t aBytes, size_t aAlignment) override
+		{
+			std::pmr::new_delete_resource()->deallocate(aPointer, aBytes, aAlignment);
+		}
+		bool do_is_equal(const std::pmr::memory_resource& aOther) const noexcept override
+		{
+			return this == &aOther;
+		}
+	};
+
+#define CHECK(aCondition) do { if (!(aCondition)) { std::printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #aCondition); ourNumFailed++; } } while (0)
+
+	//A loop over Changed<T> that writes T itself shouldn't see its own writes the next time it runs
+	void ChangedQueryIgnoresItsOwnWrites()
+	{
+		World world;
+		world.CreateBatch<TestPosition, TestVelocity>(100);
+
+		size_t visited[3] = {};
+		for (size_t run = 0; run < 3; run++)
+		{
+			for (Entity entity : world.Query<Changed<TestPosition>>())
+			{
+				entity.GetComponent<TestPosition>()->x += 1.0f;
+				visited[run]++;
+			}
+		}
+		CHECK(visited[0] == 100);
+		CHECK(visited[1] == 0);
+		CHECK(visited[2] == 0);
+
+		CachedQuery cached = world.MakeQuery<Changed<TestPosition>>();
+		size_t cachedVisited[2] = {};
+		for (size_t run = 0; run < 2; run++)
+		{
+			for (Entity entity : cached)
+			{
+				entity.GetComponent<TestPosition>()->x += 1.0f;
+				cachedVisited[run]++;
+			}
+		}
+		CHECK(cachedVisited[0] == 100);
+		CHECK(cachedVisited[1] == 0);
+	}
+
+	//Once the caches and scratch buffers have grown, iterating doesn't allocate from the world's resource anymore
+	void IterationDoesNotAllocate()
+	{
+		CountingResource resource;
+		World world(&resource);
+		world.CreateBatch<TestPosition, TestVelocity>(1000);
+		world.CreateBatch<TestPosition, TestVelocity, TestDead>(1000);
+		CachedQuery cached = world.MakeQuery<TestPosition>().Without<TestDead>();
+
+		size_t numVisited = 0;
+		auto runFrame = [&]()
+		{
+			for (Entity entity : world.Query<TestPosition, TestVelocity>()) { (void)entity; numVisited++; }
+			for (Entity entity : world.FilteredQuery<TestPosition>(std::tuple<TestDead>())) { (void)entity; numVisited++; }
+			for (Entity entity : cached) { (void)entity; numVisited++; }
+			world.Each<TestPosition, const TestVelocity>([](TestPosition& aPosition, const TestVelocity& aVelocity) { aPosition.x += aVelocity.x; });
+			world.ParallelEach<TestPosition, const TestVelocity>([](TestPosition& aPosition, const TestVelocity& aVelocity) { aPosition.y += aVelocity.y; }, 64);
+			world.ForEachChunk<TestPosition>([](std::span<TestPosition> aPositions) { for (TestPosition& position : aPositions) position.z += 1.0f; });
+		};
+
+		runFrame();
+		const size_t warmAllocations = resource.numAllocations;
+		const size_t warmVisited = numVisited;
+		for (size_t frame = 0; frame < 10; frame++)
+		{
+			runFrame();
+		}
+		CHECK(numVisited == warmVisited * 11);
+		CHECK(resource.numAllocations == warmAllocations);
+	}
+}
+
+int main()
+{
+	ChangedQueryIgnoresItsOwnWrites();
+	IterationDoesNotAllocate();
+
+	if (ourNumFailed == 0) std::printf("All ecs tests passed\n");
+	return ourNumFailed == 0 ? 0 : 1;
+}
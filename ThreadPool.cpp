@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+#include <algorithm>
+namespace ecs
+{
+	//Lets a worker find its own queue, threads outside the pool share the last one
+	static thread_local const ThreadPool* ourWorkerPool = nullptr;
+	static thread_local size_t ourWorkerQueueIndex = 0;
+
+	ThreadPool::ThreadPool(size_t aNumWorkers)
+	{
+		const size_t numWorkers = aNumWorkers ? aNumWorkers : std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1;
+		for (size_t i = 0; i < numWorkers + 1; i++)
+		{
+			myQueues.push_back(std::make_unique<Queue>());
+		}
+
+		myWorkers.reserve(numWorkers);
+		for (size_t i = 0; i < numWorkers; i++)
+		{
+			myWorkers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mySleepMutex);
+			myIsStopping = true;
+		}
+		myWakeUp.notify_all();
+		for (std::thread& worker : myWorkers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(size_t aCount, const ParallelTask& aTask)
+	{
+		if (myWorkers.empty() || aCount <= 1)
+		{
+			for (size_t index = 0; index < aCount; index++)
+			{
+				aTask(index);
+			}
+			return;
+		}
+
+		//Counted before the tasks are queued so a worker can never take one the count doesn't know of yet
+		{
+			std::lock_guard<std::mutex> lock(mySleepMutex);
+			myNumQueuedTasks += aCount;
+		}
+
+		//Dealt round robin so every thread starts out with its own share and stealing only evens out the tail
+		Batch batch;
+		batch.remaining = aCount;
+		const size_t numQueues = myQueues.size();
+		for (size_t queueIndex = 0; queueIndex < numQueues && queueIndex < aCount; queueIndex++)
+		{
+			Queue& queue = *myQueues[queueIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			for (size_t index = queueIndex; index < aCount; index += numQueues)
+			{
+				queue.tasks.push_back(Task{ &aTask, index, &batch });
+			}
+		}
+		myWakeUp.notify_all();
+
+		const size_t queueIndex = GetQueueIndex();
+		while (batch.remaining.load(std::memory_order_acquire) > 0)
+		{
+			if (!RunTask(queueIndex))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		if (batch.exception)
+		{
+			std::rethrow_exception(batch.exception);
+		}
+	}
+
+	size_t ThreadPool::GetNumWorkers() const
+	{
+		return myWorkers.size();
+	}
+
+	void ThreadPool::WorkerLoop(size_t aQueueIndex)
+	{
+		ourWorkerPool = this;
+		ourWorkerQueueIndex = aQueueIndex;
+		while (true)
+		{
+			if (RunTask(aQueueIndex)) continue;
+
+			std::unique_lock<std::mutex> lock(mySleepMutex);
+			myWakeUp.wait(lock, [this]() { return myIsStopping || myNumQueuedTasks.load() > 0; });
+			if (myIsStopping) return;
+		}
+	}
+
+	bool ThreadPool::RunTask(size_t aQueueIndex)
+	{
+		Task task;
+		if (!PopTask(aQueueIndex, task) && !StealTask(aQueueIndex, task)) return false;
+
+		myNumQueuedTasks.fetch_sub(1);
+		//Caught so the batch still finishes, a throw on a worker would otherwise terminate and leave the caller waiting
+		try
+		{
+			(*task.function)(task.index);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(task.batch->exceptionMutex);
+			if (!task.batch->exception) task.batch->exception = std::current_exception();
+		}
+		task.batch->remaining.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	bool ThreadPool::PopTask(size_t aQueueIndex, Task& outTask)
+	{
+		Queue& queue = *myQueues[aQueueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) return false;
+
+		outTask = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool ThreadPool::StealTask(size_t aQueueIndex, Task& outTask)
+	{
+		const size_t numQueues = myQueues.size();
+		for (size_t offset = 1; offset < numQueues; offset++)
+		{
+			Queue& queue = *myQueues[(aQueueIndex + offset) % numQueues];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) continue;
+
+			outTask = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	size_t ThreadPool::GetQueueIndex() const
+	{
+		return ourWorkerPool == this ? ourWorkerQueueIndex : myQueues.size() - 1;
+	}
+}
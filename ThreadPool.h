@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ecs
+{
+	using ParallelTask = std::function<void(size_t)>;
+
+	/// <summary>
+	/// Work stealing thread pool used by World::ParallelEach.
+	/// Every worker owns a queue it takes work from the back of, a worker that runs dry steals from the front of the others.
+	/// The thread that hands out work helps out until its batch is done, so nested calls from inside a task can't deadlock.
+	/// </summary>
+	class ThreadPool
+	{
+	public:
+		/// <summary>
+		/// Starts aNumWorkers threads, 0 starts one less than the amount of hardware threads since the caller helps out.
+		/// </summary>
+		explicit ThreadPool(size_t aNumWorkers = 0);
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		~ThreadPool();
+
+		/// <summary>
+		/// Calls aTask once for every index in [0, aCount) spread over the workers and the calling thread.
+		/// Returns when every call has finished. The first exception a call throws is rethrown here once no call of the batch is running anymore.
+		/// </summary>
+		void			ParallelFor(size_t aCount, const ParallelTask& aTask);
+
+		size_t			GetNumWorkers() const;
+
+	private:
+		//The calls of one ParallelFor, lives on the stack of the thread that called it
+		struct Batch
+		{
+			std::atomic<size_t> remaining; //Calls left to finish
+			std::mutex exceptionMutex;
+			std::exception_ptr exception; //First exception a call threw, rethrown by ParallelFor
+		};
+
+		struct Task
+		{
+			const ParallelTask* function;
+			size_t index;
+			Batch* batch;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> myQueues; //One per worker, the last one is shared by threads outside the pool
+		std::vector<std::thread> myWorkers;
+		std::mutex mySleepMutex;
+		std::condition_variable myWakeUp;
+		std::atomic<size_t> myNumQueuedTasks{ 0 };
+		bool myIsStopping = false;
+
+		void			WorkerLoop(size_t aQueueIndex);
+		bool			RunTask(size_t aQueueIndex);
+		bool			PopTask(size_t aQueueIndex, Task& outTask);
+		bool			StealTask(size_t aQueueIndex, Task& outTask);
+		size_t			GetQueueIndex() const;
+	};
+}
@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include "ecs_World.h"
 #include "Stage.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <utility>
 #include <mutex>
 #include "ComponentTypes.h"
@@ -16,15 +19,25 @@
 
 namespace ecs {
 
-
-
-	World::World() : mySystems(std::make_unique<SystemManager>())
+	static std::atomic<uint64_t> ourNextWorldID{ 1 };
+
+	World::World(std::pmr::memory_resource* aMemoryResource)
+		: myMemoryResource(aMemoryResource), myComponentIndex(ECS_MAX_COMPONENTS, aMemoryResource), myArchetypeIndex(aMemoryResource),
+		myEntityIndex(aMemoryResource), myArchetypeTable(aMemoryResource), myArchetypeSignatures(aMemoryResource), myComponentEntityCounts(ECS_MAX_COMPONENTS, 0, aMemoryResource), mySparseSets(aMemoryResource), myCachedQueries(aMemoryResource),
+		myClearOnLoadIndex(aMemoryResource), myClearOnLoadArchetypeList(aMemoryResource), myClearOnLoadArchetypeIDList(aMemoryResource),
+		myObserverIndex(ECS_MAX_COMPONENTS, aMemoryResource), myEventStreams(aMemoryResource), mySystems(std::make_unique<SystemManager>()),
+		myCommandBuffers(aMemoryResource), myWorldID(ourNextWorldID.fetch_add(1, std::memory_order_relaxed)), myCreatedBatch(aMemoryResource),
+		myFlushCommands(aMemoryResource), myFlushMoves(aMemoryResource), myFlushDestroyed(aMemoryResource),
+		myDestroyVictims(aMemoryResource), myDestroyRows(aMemoryResource),
+		myRowRangeBuffers(aMemoryResource)
 	{
+		mySystems->SetSyncPoint([this]() { FlushCommands(); DispatchEvents(); });
 
 		Type emptyType{};
 		myArchetypeIndex[emptyType];
 		myArchetypeIndex[emptyType].SetID(GenerateArchetypeID());
 		myArchetypeIndex[emptyType].SetType(emptyType);
+		RegisterArchetype(myArchetypeIndex[emptyType]);
 
 	}
 
@@ -47,7 +60,7 @@ namespace ecs {
 		Archetype& emptyArchetype = myArchetypeIndex.at(emptyType);
 		emptyArchetype.AddEntity(id);
 
-		myEntityIndex.emplace(id, Record{ &emptyArchetype,emptyArchetype.GetLastRow() });
+		myEntityIndex.Emplace(id, Record{ &emptyArchetype,emptyArchetype.GetLastRow() });
 		
 
 
@@ -64,46 +77,149 @@ namespace ecs {
 		Archetype& emptyArchetype = myArchetypeIndex.at(emptyType);
 		emptyArchetype.AddEntity(aEntityID);
 
-		myEntityIndex.emplace(aEntityID, Record{ &emptyArchetype,emptyArchetype.GetLastRow() });
+		myEntityIndex.Emplace(aEntityID, Record{ &emptyArchetype,emptyArchetype.GetLastRow() });
 		return e;
 	}
 
 	bool World::DestroyEntity(ecs::EntityID id)
 	{
-		if (!myEntityIndex.contains(id)) return false;
+		return DestroyEntities({ &id, 1 }) != 0;
+	}
 
-		auto record = myEntityIndex.at(id);
-		Archetype* archetype = record.archetype;
-		size_t sourceRow = record.row;
-		size_t lastRow = 0;
+	size_t World::DestroyEntities(std::span<const EntityID> aEntities)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		return DestroyEntityList(aEntities);
+	}
 
-		if (!archetype->IsEmpty())
+	size_t World::DestroyEntityList(std::span<const EntityID> aEntities)
+	{
+		std::pmr::vector<Victim>& victims = myDestroyVictims;
+		victims.clear();
+		victims.reserve(aEntities.size());
+		for (EntityID entity : aEntities)
 		{
-			lastRow = archetype->GetLastRow();
+			if (const Record* record = myEntityIndex.Find(entity))
+			{
+				victims.push_back(Victim{ record->archetype, record->row });
+			}
 		}
 
-		std::vector<ecs::EntityID>& entities = archetype->GetEntityList();
+		auto order = [](const Victim& aLeft, const Victim& aRight)
+		{
+			if (aLeft.archetype != aRight.archetype) return aLeft.archetype->GetID() < aRight.archetype->GetID();
+			return aLeft.row < aRight.row;
+		};
+		auto same = [](const Victim& aLeft, const Victim& aRight)
+		{
+			return aLeft.archetype == aRight.archetype && aLeft.row == aRight.row;
+		};
+		std::sort(victims.begin(), victims.end(), order);
+		victims.erase(std::unique(victims.begin(), victims.end(), same), victims.end());
 
-		if (sourceRow != lastRow)
+		std::pmr::vector<size_t>& rows = myDestroyRows;
+		for (size_t first = 0; first < victims.size();)
+		{
+			Archetype* archetype = victims[first].archetype;
+			rows.clear();
+			for (; first < victims.size() && victims[first].archetype == archetype; first++)
+			{
+				rows.push_back(victims[first].row);
+			}
+			DestroyArchetypeRows(*archetype, rows);
+		}
+		return victims.size();
+	}
+
+	void World::MakePrefab(EntityID aEntity)
+	{
+		if (!HasComponent<Prefab>(aEntity))
 		{
-			ecs::EntityID entityToShuffle = archetype->GetEntity(lastRow);
+			AddComponent<Prefab>(aEntity);
+		}
+	}
 
-			ecs::Record& shuffleRecord = myEntityIndex.at(entityToShuffle);
-			shuffleRecord.row = sourceRow; //this is the shuffled entities new row.
-			entities.at(shuffleRecord.row) = entities.at(lastRow);
-			archetype->ShuffleEntity(lastRow, sourceRow);
+	std::span<const EntityID> World::Instantiate(EntityID aPrefab, size_t aCount)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		myCreatedBatch.clear();
+		const Record* record = myEntityIndex.Find(aPrefab);
+		if (!record || aCount == 0) return myCreatedBatch;
+
+		Archetype& source = *record->archetype;
+		const size_t sourceRow = record->row;
+		Type type = source.GetType();
+		type.erase(std::remove(type.begin(), type.end(), GetComponentID<Prefab>()), type.end());
+
+		Archetype& archetype = GetOrCreateArchetype(type);
+		const size_t firstRow = archetype.GetNumEntities();
+		archetype.ReserveRows(firstRow + aCount);
+
+		myCreatedBatch.reserve(aCount);
+		AddBatchEntities(archetype, firstRow, aCount);
+
+		for (size_t i = 0; i < archetype.GetNumComponents(); i++)
+		{
+			Column* column = archetype.GetColumn(i);
+			const int sourceColumnIndex = source.FindColumnIndex(column->GetTypeInfo().typeID);
+			column->CopyConstructRows(source.GetColumn(sourceColumnIndex)->GetComponent(sourceRow), firstRow, aCount);
+			column->ChangeMemoryUsed(static_cast<int>(aCount));
 		}
-		InvalidateCachedQueryFromMove(archetype, nullptr);
 
-		myEntityIndex.erase(id);
-		entities.pop_back();
-		return true;
+		if (source.HasDisabledComponents())
+		{
+			for (size_t row = firstRow; row < firstRow + aCount; row++)
+			{
+				archetype.CopyEnabledState(source, sourceRow, row);
+			}
+		}
+		archetype.SetRowsAdded(firstRow, firstRow + aCount, GetChangeTick());
+		RecordRowEvents(archetype, firstRow, firstRow + aCount, ObserverType::OnAdd);
+
+		for (SparseSet& sparseSet : mySparseSets)
+		{
+			if (!sparseSet.Contains(aPrefab)) continue;
+
+			const void* prefabComponent = sparseSet.Get(aPrefab);
+
+			const ComponentTypeInfo& typeInfo = sparseSet.GetTypeInfo();
+			for (EntityID entity : myCreatedBatch)
+			{
+				RecordEvent(typeInfo.typeID, ObserverType::OnAdd, entity);
+				void* component = sparseSet.Emplace(entity);
+				if (!component || !typeInfo.copy) continue;
+				if (typeInfo.destruct) typeInfo.destruct(component);
+				typeInfo.copy(component, prefabComponent);
+			}
+		}
+
+		TrackClearOnLoad(archetype);
+		return myCreatedBatch;
 	}
 
+	void World::DestroyArchetypeRows(Archetype& aArchetype, std::span<const size_t> aRows)
+	{
+		const std::pmr::vector<EntityID>& entities = aArchetype.GetEntityList();
+		for (size_t row : aRows)
+		{
+			RecordRowEvents(aArchetype, row, row + 1, ObserverType::OnRemove);
+			RemoveSparseComponents(entities[row]);
+			myEntityIndex.Erase(entities[row]);
+		}
+
+		aArchetype.RemoveRows(aRows);
+
+		//Holes below the new end were filled from the back
+		for (size_t row : aRows)
+		{
+			if (row >= entities.size()) break;
+			myEntityIndex.At(entities[row]).row = row;
+		}
+	}
 
 	Entity World::GetEntity(EntityID id)
 	{
-		if (!myEntityIndex.contains(id))
+		if (!myEntityIndex.Contains(id))
 		{
 			return Entity(ECS_ENTITY_NULL, this);
 		}
@@ -112,12 +228,12 @@ namespace ecs {
 
 	bool World::IsNull(EntityID id)
 	{
-		return !myEntityIndex.contains(id);
+		return !myEntityIndex.Contains(id);
 	}
 
 	const ecs::Archetype* ecs::World::GetArchetype(EntityID aEntity) const
 	{
-		return myEntityIndex.at(aEntity).archetype;
+		return myEntityIndex.At(aEntity).archetype;
 	}
 
 	float World::DeltaTime() const
@@ -140,9 +256,19 @@ namespace ecs {
 		return mySystems->TickCount();
 	}
 
-	void World::CreateStage(std::string& aStageName)
+	std::pmr::memory_resource* World::GetMemoryResource() const
 	{
-		myStages.emplace(aStageName,std::make_unique<Stage>(this));
+		return myMemoryResource;
+	}
+
+	void World::CreateStage(std::string& aStageName, std::pmr::memory_resource* aMemoryResource)
+	{
+		auto stage = std::make_unique<Stage>(this, aMemoryResource ? aMemoryResource : myMemoryResource);
+		for (ComponentID componentID = 0; componentID < mySparseSets.size(); componentID++)
+		{
+			if (IsSparseComponent(componentID)) stage->RegisterSparseComponent(componentID);
+		}
+		myStages.emplace(aStageName, std::move(stage));
 	}
 
 	Stage* World::GetStage(std::string& aStageName)
@@ -152,34 +278,501 @@ namespace ecs {
 		return myStages.at(aStageName).get();
 	}
 
-	void World::InvalidateCachedQueryFromMove(Archetype* oldArchetype, Archetype* newArchetype)
+	void World::RegisterArchetype(Archetype& aArchetype)
 	{
-		if (oldArchetype)
+		const ArchetypeID id = aArchetype.GetID();
+		if (myArchetypeTable.size() <= id)
 		{
+			myArchetypeTable.resize(id + 1, nullptr);
+			myArchetypeSignatures.resize(id + 1);
+		}
+		myArchetypeTable[id] = &aArchetype;
+		myArchetypeSignatures[id] = aArchetype.GetSignature();
+		aArchetype.SetEntityCounts(myComponentEntityCounts.data());
 
-			auto oldArchetypeID = oldArchetype->GetID();
-			if (myArchetypeToQueries.contains(oldArchetypeID))
+		for (auto& [hash, cache] : myCachedQueries)
+		{
+			if (cache.Matches(aArchetype.GetSignature()))
 			{
-				for (const auto& queryHash : myArchetypeToQueries.at(oldArchetypeID))
+				cache.archetypes.push_back(&aArchetype);
+			}
+		}
+	}
+
+	void World::RegisterSparseComponent(ComponentID aComponentID)
+	{
+		if (IsSparseComponent(aComponentID)) return;
+		assert(myComponentIndex[aComponentID].empty(), "Component is already stored in archetypes, register sparse components before using them");
+
+		if (mySparseSets.size() <= aComponentID)
+		{
+			mySparseSets.resize(aComponentID + 1);
+		}
+		mySparseSets[aComponentID].SetTypeInfo(ComponentRegistry::GetTypeInfo(aComponentID));
+		mySparseComponents.set(aComponentID);
+
+		//Caches made before the registration matched the component against archetypes
+		for (auto& [hash, cache] : myCachedQueries)
+		{
+			if (cache.terms.required.test(aComponentID) || cache.terms.excluded.test(aComponentID))
+			{
+				BuildQueryCache(cache);
+			}
+		}
+	}
+
+	QueryCache& World::GetQueryCache(const QueryTerms& aTerms)
+	{
+		const CachedQueryHash hash = aTerms.GetHash();
+		auto [first, last] = myCachedQueries.equal_range(hash);
+		for (; first != last; ++first)
+		{
+			if (first->second.terms == aTerms) return first->second;
+		}
+
+		assert(((aTerms.changed | aTerms.added) & mySparseComponents).none(), "Sparse components have no change ticks, Changed and Added only work on archetype components");
+		QueryCache& cache = myCachedQueries.emplace(hash, QueryCache{ aTerms, {}, {}, {}, {}, std::pmr::vector<Archetype*>(myMemoryResource), std::pmr::unordered_map<size_t, ChangeTick>(myMemoryResource) })->second;
+		BuildQueryCache(cache);
+		return cache;
+	}
+
+	void World::BuildQueryCache(QueryCache& aCache) const
+	{
+		//Sparse components are not part of any archetype, they are checked per entity while iterating
+		aCache.sparseRequired = aCache.terms.required & mySparseComponents;
+		aCache.sparseExcluded = aCache.terms.excluded & mySparseComponents;
+		aCache.denseRequired = aCache.terms.required & ~mySparseComponents;
+		aCache.denseExcluded = aCache.terms.excluded & ~mySparseComponents;
+		assert((aCache.terms.GetGroupComponents() & mySparseComponents).none(), "Optional, AnyOf and OneOf are matched per archetype and can't name sparse components");
+
+		//Prefabs only match when they are asked for
+		const ComponentID prefabID = GetComponentID<Prefab>();
+		if (!(aCache.terms.required | aCache.terms.GetGroupComponents()).test(prefabID)) aCache.denseExcluded.set(prefabID);
+
+		aCache.archetypes.clear();
+		MatchArchetypes(aCache, aCache.archetypes);
+	}
+
+	ChangeTick World::GetChangeTick() const
+	{
+		return myChangeTick.load(std::memory_order_relaxed);
+	}
+
+	ChangeTick World::AdvanceChangeTick(ChangeTick& aLastRunTick)
+	{
+		//Two ticks, the first one is the run's own and the world moves on to the second
+		const ChangeTick changedSince = aLastRunTick;
+		aLastRunTick = myChangeTick.fetch_add(2, std::memory_order_relaxed) + 1;
+		return changedSince;
+	}
+
+	ThreadPool& World::GetThreadPool()
+	{
+		std::call_once(myThreadPoolOnce, [this]() { myThreadPool = std::make_unique<ThreadPool>(); });
+		return *myThreadPool;
+	}
+
+	std::pmr::vector<World::RowRange> World::AcquireRowRanges()
+	{
+		std::lock_guard<std::mutex> lock(myRowRangeMutex);
+		if (myRowRangeBuffers.empty()) return std::pmr::vector<RowRange>(myMemoryResource);
+
+		std::pmr::vector<RowRange> ranges = std::move(myRowRangeBuffers.back());
+		myRowRangeBuffers.pop_back();
+		return ranges;
+	}
+
+	void World::ReleaseRowRanges(std::pmr::vector<RowRange>&& aRanges)
+	{
+		aRanges.clear();
+		std::lock_guard<std::mutex> lock(myRowRangeMutex);
+		myRowRangeBuffers.push_back(std::move(aRanges));
+	}
+
+	CommandBuffer& World::GetCommandBuffer()
+	{
+		//Keyed on the world id rather than the address so a new world at the address of a destroyed one never finds its buffer
+		thread_local std::unordered_map<uint64_t, CommandBuffer*> threadCommandBuffers;
+		auto it = threadCommandBuffers.find(myWorldID);
+		if (it != threadCommandBuffers.end())
+		{
+			return *it->second;
+		}
+
+		//Recording happens from worker threads, so buffers draw from the default resource instead of the worlds which doesn't have to be thread safe
+		const std::lock_guard<std::mutex> lock(myCommandBufferMutex);
+		myCommandBuffers.push_back(std::make_unique<CommandBuffer>(this, std::pmr::get_default_resource()));
+		CommandBuffer* commandBuffer = myCommandBuffers.back().get();
+		threadCommandBuffers.emplace(myWorldID, commandBuffer);
+		return *commandBuffer;
+	}
+
+	void World::DispatchEvents()
+	{
+		assert(!myIsDispatchingEvents, "DispatchEvents called from inside a subscriber");
+		myIsDispatchingEvents = true;
+		for (EventStream& eventStream : myEventStreams)
+		{
+			if (eventStream.HasEvents()) eventStream.Dispatch();
+		}
+		myIsDispatchingEvents = false;
+	}
+
+	void World::RecordEvents(const ComponentMask& aComponents, ObserverType aType, EntityID aEntity)
+	{
+		const ComponentMask observed = aComponents & myObservedComponents[static_cast<size_t>(aType)];
+		if (observed.none()) return;
+
+		std::lock_guard<std::mutex> lock(myEventMutex);
+		for (ComponentID componentID = 0; componentID < ECS_MAX_COMPONENTS; componentID++)
+		{
+			if (observed.test(componentID)) myEventStreams[componentID * ECS_OBSERVER_TYPE_COUNT + static_cast<size_t>(aType)].Record(aEntity);
+		}
+	}
+
+	void World::RecordRowEvents(Archetype& aArchetype, size_t aFirstRow, size_t aLastRow, ObserverType aType)
+	{
+		if ((aArchetype.GetSignature() & myObservedComponents[static_cast<size_t>(aType)]).none()) return;
+
+		std::lock_guard<std::mutex> lock(myEventMutex);
+		const std::pmr::vector<EntityID>& entities = aArchetype.GetEntityList();
+		for (ComponentID componentID : aArchetype.GetType())
+		{
+			if (!myObservedComponents[static_cast<size_t>(aType)].test(componentID)) continue;
+
+			EventStream& eventStream = myEventStreams[componentID * ECS_OBSERVER_TYPE_COUNT + static_cast<size_t>(aType)];
+			for (size_t row = aFirstRow; row < aLastRow; row++)
+			{
+				eventStream.Record(entities[row]);
+			}
+		}
+	}
+
+	void World::FlushCommands()
+	{
+		using Command = CommandBuffer::Command;
+		using CommandType = CommandBuffer::CommandType;
+
+		const std::lock_guard<std::mutex> bufferLock(myCommandBufferMutex);
+		std::pmr::vector<const Command*>& commands = myFlushCommands;
+		commands.clear();
+		for (const auto& commandBuffer : myCommandBuffers)
+		{
+			for (const Command& command : commandBuffer->myCommands)
+			{
+				commands.push_back(&command);
+			}
+		}
+		if (commands.empty()) return;
+
+		const std::lock_guard<std::mutex> lock(myMutex);
+
+		//Commands for the same entity end up next to each other in the order they were recorded
+		std::stable_sort(commands.begin(), commands.end(), [](const Command* a, const Command* b) { return a->entity < b->entity; });
+
+		std::pmr::vector<PendingMove>& moves = myFlushMoves;
+		std::pmr::vector<EntityID>& destroyed = myFlushDestroyed;
+		moves.clear();
+		destroyed.clear();
+
+		Archetype& emptyArchetype = myArchetypeIndex.at(Type{});
+		for (size_t first = 0; first < commands.size();)
+		{
+			const EntityID entity = commands[first]->entity;
+			size_t last = first;
+			bool isDestroyed = false;
+			for (; last < commands.size() && commands[last]->entity == entity; last++)
+			{
+				if (commands[last]->type == CommandType::Create && !myEntityIndex.Contains(entity))
 				{
-					myCachedQueries.erase(queryHash);
+					emptyArchetype.AddEntity(entity);
+					myEntityIndex.Emplace(entity, Record{ &emptyArchetype, emptyArchetype.GetLastRow() });
 				}
-				myArchetypeToQueries.erase(oldArchetypeID);
+				isDestroyed |= commands[last]->type == CommandType::Destroy;
+			}
+
+			if (isDestroyed)
+			{
+				destroyed.push_back(entity);
 			}
+			else if (myEntityIndex.Contains(entity))
+			{
+				//Every add and remove for the entity folds into one target signature
+				Archetype* source = myEntityIndex.At(entity).archetype;
+				ComponentMask signature = source->GetSignature();
+				for (size_t i = first; i < last; i++)
+				{
+					const Command& command = *commands[i];
+					if (command.componentID == ECS_COMPONENT_NULL || IsSparseComponent(command.componentID)) continue;
+					if (command.type == CommandType::Add) signature.set(command.componentID);
+					if (command.type == CommandType::Remove) signature.reset(command.componentID);
+				}
+
+				Archetype* target = source;
+				if (signature != source->GetSignature())
+				{
+					Type targetType;
+					for (ComponentID componentID = 0; componentID < ECS_MAX_COMPONENTS; componentID++)
+					{
+						if (signature.test(componentID)) targetType.push_back(componentID);
+					}
+					target = &GetOrCreateArchetype(targetType);
+				}
+				moves.push_back(PendingMove{ entity, source, target, first, last });
+			}
+			first = last;
+		}
+
+		//Destroyed entities are removed per archetype so their components are destructed and each archetype compacts once
+		DestroyEntityList(destroyed);
+
+		std::sort(moves.begin(), moves.end(), [](const PendingMove& a, const PendingMove& b)
+			{
+				if (a.source->GetID() != b.source->GetID()) return a.source->GetID() < b.source->GetID();
+				return a.target->GetID() < b.target->GetID();
+			});
+
+		for (const PendingMove& move : moves)
+		{
+			if (move.target != move.source)
+			{
+				MoveEntityFromToArchetype(*move.source, move.entity, *move.target);
+				TrackClearOnLoad(*move.target);
+			}
+
+			//Components that weren't in the source archetype are constructed, recorded values are moved in
+			const Record& record = myEntityIndex.At(move.entity);
+			ComponentMask constructed;
+			for (size_t i = move.firstCommand; i < move.lastCommand; i++)
+			{
+				const Command& command = *commands[i];
+				const ComponentID componentID = command.componentID;
+				if (componentID == ECS_COMPONENT_NULL) continue;
+				if (IsSparseComponent(componentID))
+				{
+					if (command.type == CommandType::Remove && mySparseSets[componentID].Erase(move.entity))
+					{
+						RecordEvent(componentID, ObserverType::OnRemove, move.entity);
+					}
+					if (command.type != CommandType::Add) continue;
+
+					const bool exists = mySparseSets[componentID].Contains(move.entity);
+					if (!exists || command.payload)
+					{
+						RecordEvent(componentID, exists ? ObserverType::OnSet : ObserverType::OnAdd, move.entity);
+					}
+					void* component = mySparseSets[componentID].Emplace(move.entity);
+					if (component && command.payload)
+					{
+						const ComponentTypeInfo& typeInfo = mySparseSets[componentID].GetTypeInfo();
+						if (!typeInfo.isTrivial && typeInfo.destruct) typeInfo.destruct(component);
+						typeInfo.isTrivial ? (void)std::memcpy(component, command.payload, typeInfo.size) : typeInfo.move(component, command.payload);
+					}
+					continue;
+				}
+
+				if (command.type != CommandType::Add || !move.target->HasComponent(componentID)) continue;
+				const int columnIndex = move.target->FindColumnIndex(componentID);
+				if (columnIndex < 0) continue;
+
+				Column* column = move.target->GetColumn(columnIndex);
+				const ComponentTypeInfo& typeInfo = column->GetTypeInfo();
+				void* component = column->GetComponent(record.row);
+				const bool exists = move.source->HasComponent(componentID) || constructed.test(componentID);
+				if (exists && !command.payload) continue;
+
+				if (exists)
+				{
+					if (!typeInfo.isTrivial && typeInfo.destruct) typeInfo.destruct(component);
+					MarkChanged(*move.target, componentID, record.row);
+					RecordEvent(componentID, ObserverType::OnSet, move.entity);
+				}
+				else
+				{
+					column->ChangeMemoryUsed(1);
+					constructed.set(componentID);
+				}
+
+				if (command.payload)
+				{
+					typeInfo.isTrivial ? (void)std::memcpy(component, command.payload, typeInfo.size) : typeInfo.move(component, command.payload);
+				}
+				else if (typeInfo.construct)
+				{
+					typeInfo.construct(component);
+				}
+				else
+				{
+					std::memset(component, 0, typeInfo.size);
+				}
+			}
+		}
+
+		for (auto& commandBuffer : myCommandBuffers)
+		{
+			commandBuffer->Clear();
+		}
+	}
+
+	Archetype& World::GetOrCreateArchetype(const Type& aType)
+	{
+		auto it = myArchetypeIndex.find(aType);
+		if (it != myArchetypeIndex.end())
+		{
+			return it->second;
+		}
+
+		Archetype& archetype = myArchetypeIndex[aType];
+		archetype.SetID(GenerateArchetypeID());
+		archetype.SetType(aType);
+		RegisterArchetype(archetype);
+
+		//Same column layout as AddArchetypeFromSource, type order with tags left out
+		int numColumns = 0;
+		for (ComponentID componentID : aType)
+		{
+			ArchetypeRecord& archetypeRecord = myComponentIndex[componentID][archetype.GetID()];
+			archetypeRecord.archetype = &archetype;
+			archetypeRecord.columnIndex = ComponentRegistry::GetTypeInfo(componentID).isTag ? -1 : numColumns++;
 		}
 
-		if (newArchetype)
+		archetype.ReserveComponentsSize(numColumns);
+		archetype.ResizeComponents(numColumns);
+		for (ComponentID componentID : aType)
+		{
+			const int columnIndex = myComponentIndex[componentID].at(archetype.GetID()).columnIndex;
+			if (columnIndex < 0) continue;
+
+			archetype.GetColumn(columnIndex)->AssignTypeInfo(ComponentRegistry::GetTypeInfo(componentID));
+		}
+		return archetype;
+	}
+
+	void World::TrackClearOnLoad(Archetype& aArchetype)
+	{
+		if (aArchetype.HasComponent(GetComponentID<DontDestroyOnLoad>()) || myClearOnLoadIndex.contains(aArchetype.GetID())) return;
+
+		myClearOnLoadIndex.emplace(aArchetype.GetID(), myClearOnLoadArchetypeList.size());
+		myClearOnLoadArchetypeList.emplace_back(&aArchetype.GetType());
+	}
+
+	bool World::MatchesSparseComponents(EntityID aEntity, const ComponentMask& aRequired, const ComponentMask& aExcluded) const
+	{
+		for (ComponentID componentID = 0; componentID < mySparseSets.size(); componentID++)
+		{
+			if (aRequired.test(componentID) && !mySparseSets[componentID].Contains(aEntity)) return false;
+			if (aExcluded.test(componentID) && mySparseSets[componentID].Contains(aEntity)) return false;
+		}
+		return true;
+	}
+
+	void World::RemoveSparseComponents(EntityID aEntity)
+	{
+		if (mySparseComponents.none()) return;
+
+		for (ComponentID componentID = 0; componentID < mySparseSets.size(); componentID++)
+		{
+			if (mySparseSets[componentID].Erase(aEntity))
+			{
+				RecordEvent(componentID, ObserverType::OnRemove, aEntity);
+			}
+		}
+	}
+
+	void World::MatchArchetypes(const QueryCache& aCache, std::pmr::vector<Archetype*>& outArchetypes) const
+	{
+		const ComponentID seedComponent = GetSeedComponent(aCache.denseRequired);
+		if (seedComponent == ECS_COMPONENT_NULL)
 		{
-			auto newArchetypeID = newArchetype->GetID();
-			if (myArchetypeToQueries.contains(newArchetypeID))
+			for (size_t i = 0; i < myArchetypeSignatures.size(); i++)
 			{
-				for (const auto& queryHash : myArchetypeToQueries.at(newArchetypeID))
+				if (!aCache.Matches(myArchetypeSignatures[i])) continue;
+
+				Archetype* archetype = myArchetypeTable[i];
+				if (archetype)
 				{
-					myCachedQueries.erase(queryHash);
+					outArchetypes.push_back(archetype);
 				}
-				myArchetypeToQueries.erase(newArchetypeID);
 			}
+			return;
+		}
+
+		//The other required components are tested rarest first, so most candidates are turned down by the first test
+		std::array<ComponentID, ECS_MAX_COMPONENTS> remaining;
+		size_t numRemaining = 0;
+		ForEachComponent(aCache.denseRequired, [&](ComponentID aComponentID)
+			{
+				if (aComponentID != seedComponent) remaining[numRemaining++] = aComponentID;
+			});
+		std::sort(remaining.begin(), remaining.begin() + numRemaining, [this](ComponentID aLeft, ComponentID aRight)
+			{
+				return myComponentIndex[aLeft].size() < myComponentIndex[aRight].size();
+			});
+
+		//Only the archetypes that have the rarest required component can match
+		const size_t firstMatch = outArchetypes.size();
+		for (const auto& [archetypeID, record] : myComponentIndex[seedComponent])
+		{
+			if (archetypeID >= myArchetypeSignatures.size()) continue;
+
+			const ComponentMask& signature = myArchetypeSignatures[archetypeID];
+			const bool hasRemaining = std::all_of(remaining.begin(), remaining.begin() + numRemaining, [&](ComponentID aComponentID) { return signature.test(aComponentID); });
+			if (!hasRemaining || (signature & aCache.denseExcluded).any() || !aCache.terms.MatchesGroups(signature)) continue;
+
+			outArchetypes.push_back(record.archetype);
 		}
+		//The map is unordered, sorted so archetypes are still visited in the order they were created
+		std::sort(outArchetypes.begin() + firstMatch, outArchetypes.end(),
+			[](const Archetype* aLeft, const Archetype* aRight) { return aLeft->GetID() < aRight->GetID(); });
+	}
+
+	ComponentID World::GetSeedComponent(const ComponentMask& aRequired) const
+	{
+		ComponentID seedComponent = ECS_COMPONENT_NULL;
+		size_t fewestArchetypes = SIZE_MAX;
+		ForEachComponent(aRequired, [&](ComponentID aComponentID)
+			{
+				const size_t numArchetypes = myComponentIndex[aComponentID].size();
+				if (numArchetypes < fewestArchetypes)
+				{
+					seedComponent = aComponentID;
+					fewestArchetypes = numArchetypes;
+				}
+			});
+		return seedComponent;
+	}
+
+	size_t World::GetNumEntitiesWith(ComponentID aComponentID) const
+	{
+		if (IsSparseComponent(aComponentID)) return mySparseSets[aComponentID].GetSize();
+		return myComponentEntityCounts[aComponentID];
+	}
+
+	QueryPlan World::ExplainQuery(const QueryTerms& aTerms) const
+	{
+		QueryCache cache{ aTerms, {}, {}, {}, {}, std::pmr::vector<Archetype*>(myMemoryResource), std::pmr::unordered_map<size_t, ChangeTick>(myMemoryResource) };
+		BuildQueryCache(cache);
+
+		QueryPlan plan;
+		plan.seedComponent = GetSeedComponent(cache.denseRequired);
+		plan.numCandidates = plan.seedComponent == ECS_COMPONENT_NULL ? myArchetypeSignatures.size() : myComponentIndex[plan.seedComponent].size();
+		plan.numArchetypes = cache.archetypes.size();
+		for (const Archetype* archetype : cache.archetypes)
+		{
+			plan.numRows += archetype->GetNumEntities();
+		}
+
+		ForEachComponent(aTerms.required, [&](ComponentID aComponentID)
+			{
+				const bool isSparse = IsSparseComponent(aComponentID);
+				plan.required.push_back(QueryPlan::Term{ aComponentID, isSparse ? 0 : myComponentIndex[aComponentID].size(), GetNumEntitiesWith(aComponentID), isSparse });
+			});
+		std::sort(plan.required.begin(), plan.required.end(), [](const QueryPlan::Term& aLeft, const QueryPlan::Term& aRight)
+			{
+				if (aLeft.isSparse != aRight.isSparse) return !aLeft.isSparse;
+				return aLeft.isSparse ? aLeft.numEntities < aRight.numEntities : aLeft.numArchetypes < aRight.numArchetypes;
+			});
+		return plan;
 	}
 
 	void World::system(const char* aName, System&& aSystem, Pipeline aPipeline) const
@@ -195,9 +788,33 @@ namespace ecs {
 
 	void World::Clear()
 	{
-		myEntityIndex.clear();
+		{
+			const std::lock_guard<std::mutex> lock(myCommandBufferMutex);
+			for (auto& commandBuffer : myCommandBuffers)
+			{
+				commandBuffer->Clear();
+			}
+		}
+		myEntityIndex.Clear();
+		for (EventStream& eventStream : myEventStreams)
+		{
+			eventStream.ClearEvents();
+		}
+		for (auto& [hash, cache] : myCachedQueries)
+		{
+			cache.archetypes.clear();
+		}
 		myArchetypeIndex.clear();
-		myComponentIndex.clear();
+		myArchetypeTable.clear();
+		myArchetypeSignatures.clear();
+		for (SparseSet& sparseSet : mySparseSets)
+		{
+			sparseSet.Clear();
+		}
+		for (ArchetypeMap& archetypeMap : myComponentIndex)
+		{
+			archetypeMap.clear();
+		}
 		myClearOnLoadArchetypeList.clear();
 		myClearOnLoadArchetypeIDList.clear();
 		myClearOnLoadIndex.clear();
@@ -205,6 +822,7 @@ namespace ecs {
 		myArchetypeIndex[emptyType];
 		myArchetypeIndex[emptyType].SetID(GenerateArchetypeID());
 		myArchetypeIndex[emptyType].SetType(emptyType);
+		RegisterArchetype(myArchetypeIndex[emptyType]);
 	}
 
 	void World::SetDontDestroyOnLoad(ecs::EntityID aEntityID)
@@ -216,7 +834,7 @@ namespace ecs {
 
 		if (HasComponent<Parent>(aEntityID))
 		{
-			ecs::EntityID parent = GetComponent<Parent>(aEntityID)->GetParent();
+			ecs::EntityID parent = GetComponent<const Parent>(aEntityID)->GetParent();
 			if (parent != ECS_ENTITY_NULL)
 			{
 				SetDontDestroyOnLoad(parent);
@@ -225,14 +843,13 @@ namespace ecs {
 	}
 	CleanUp World::PrepareCleanupForLevelLoad()
 	{
-		myCachedQueries.clear();
-		std::vector<std::vector<ecs::EntityID>> entitiesToRemove;
+		std::vector<std::pmr::vector<ecs::EntityID>> entitiesToRemove;
 		CleanUp cleanUp{};
 		
 		for (auto e : FilteredQuery<CCollider>(std::tuple<DontDestroyOnLoad,RagdollTag>())) 
 		{
 			
-			auto col = e.GetComponent<CCollider>();
+			auto col = e.GetComponent<const CCollider>();
 			//Parent* parent = e.GetComponent<Parent>(); 
 			cleanUp.colliderEntitiesToRemove.emplace_back(col->myBodyID, e.GetID());
 
@@ -252,11 +869,10 @@ namespace ecs {
 		{
 			for (auto e : el)
 			{
-				myEntityIndex.erase(e);
+				RemoveSparseComponents(e);
+				myEntityIndex.Erase(e);
 			}
 		}
-		myCachedQueries.clear();
-		myArchetypeToQueries.clear();
 		myClearOnLoadArchetypeList.clear();
 		myClearOnLoadIndex.clear();
 		return cleanUp;
@@ -267,7 +883,47 @@ namespace ecs {
 	}
 	bool World::Progress()
 	{
-		return mySystems->Progress();
+		const bool isRunning = mySystems->Progress();
+		ReclaimMemory();
+		return isRunning;
+	}
+
+	void World::SetMemoryReclaimPolicy(const MemoryReclaimPolicy& aPolicy)
+	{
+		myMemoryReclaimPolicy = aPolicy;
+	}
+
+	size_t World::TrimMemory()
+	{
+		const std::lock_guard<std::mutex> lock(myMutex);
+		size_t releasedBytes = 0;
+		for (auto& [type, archetype] : myArchetypeIndex)
+		{
+			releasedBytes += archetype.ReleaseUnusedChunks();
+			archetype.GetEntityList().shrink_to_fit();
+		}
+		return releasedBytes;
+	}
+
+	size_t World::GetResidentMemory() const
+	{
+		size_t residentBytes = 0;
+		for (const auto& [type, archetype] : myArchetypeIndex)
+		{
+			residentBytes += archetype.GetChunkMemory();
+		}
+		return residentBytes;
+	}
+
+	void World::ReclaimMemory()
+	{
+		if (!myMemoryReclaimPolicy.enabled) return;
+
+		const std::lock_guard<std::mutex> lock(myMutex);
+		for (auto& [type, archetype] : myArchetypeIndex)
+		{
+			archetype.UpdateMemoryReclaim(myMemoryReclaimPolicy);
+		}
 	}
 
 	void World::Quit()
@@ -277,10 +933,24 @@ namespace ecs {
 
 	ecs::EntityID World::GenerateID()
 	{
+		if (myIDSource != this) return myIDSource->GenerateID();
+
 		const std::lock_guard<std::mutex> lock(myEntityGenerationMutex);
-		ecs::EntityID id = myNextEntity++;
+		return myEntityIndex.Generate();
+	}
 
-		return id;
+	void World::AddBatchEntities(Archetype& aArchetype, size_t aFirstRow, size_t aCount)
+	{
+		//Ids come from the source index, a stage only keeps its own records for them until it merges
+		std::lock_guard<std::mutex> generationLock(myIDSource->myEntityGenerationMutex);
+		myIDSource->myEntityIndex.Reserve(aCount);
+		for (size_t i = 0; i < aCount; i++)
+		{
+			const EntityID entity = myIDSource->myEntityIndex.Generate();
+			myEntityIndex.Emplace(entity, Record{ &aArchetype, aFirstRow + i });
+			aArchetype.AddEntity(entity);
+			myCreatedBatch.push_back(entity);
+		}
 	}
 
 	ecs::ArchetypeID World::GenerateArchetypeID()
@@ -292,30 +962,17 @@ namespace ecs {
 
 	void ecs::World::MoveEntityFromToArchetype(Archetype& aArchetype, EntityID aEntity, Archetype& aNewArchetype)
 	{
-		InvalidateCachedQueryFromMove(&aArchetype, &aNewArchetype);
-		Record& record = myEntityIndex.at(aEntity);
+		Record& record = myEntityIndex.At(aEntity);
 		assert(record.archetype, "Archetype was null");
 		aNewArchetype.AddEntity(aEntity); // the archetype count increases by 1
 		size_t aNewRow = aNewArchetype.GetLastRow();
 
 		size_t sourceRow = record.row;
-		//if moving from one archetype to another and the new archetype dont have enough memory double the size of the new allocation. 
+		//if the new archetype is out of rows allocate one more chunk for all of its columns, rows already stored are never moved.
 		if (aNewArchetype.GetNumEntities() > aNewArchetype.GetMaxCount())
 		{
-			for (size_t i = 0; i < aArchetype.GetNumTypes(); i++)
-			{
-				ComponentID sourceID = aArchetype.GetComponentIDFromTypeList(i);
-
-				ecs::ArchetypeMap& archetypeMap = myComponentIndex.at(sourceID);
-				if (archetypeMap.at(aArchetype.GetID()).columnIndex == -1) continue;
-				if (!archetypeMap.contains(aNewArchetype.GetID())) continue;
-
-				size_t targetColumnIndex = archetypeMap.at(aNewArchetype.GetID()).columnIndex;
-				if (targetColumnIndex == -1) continue; //Its a tag;
-				aNewArchetype.GetColumn(targetColumnIndex)->Resize(aNewArchetype.GetColumn(targetColumnIndex)->GetCapacity() * 2);
-			}
-			aNewArchetype.SetMaxCount(aNewArchetype.GetMaxCount() * 2);
-		};
+			aNewArchetype.AddChunk();
+		}
 
 		for (size_t i = 0; i < aArchetype.GetNumTypes(); i++)
 		{
@@ -338,6 +995,10 @@ namespace ecs {
 			void* targetComponent = aNewArchetype.GetColumn(targetColumnIndex)->GetComponent(aNewRow);
 			aNewArchetype.GetColumn(targetColumnIndex)->MoveOrCopyDataFromTo(sourceComponent, targetComponent);
 		}
+		aNewArchetype.CopyEnabledState(aArchetype, sourceRow, aNewRow);
+		aNewArchetype.CopyChangeTicks(aArchetype, sourceRow, aNewRow, GetChangeTick());
+		RecordEvents(aNewArchetype.GetSignature() & ~aArchetype.GetSignature(), ObserverType::OnAdd, aEntity);
+		RecordEvents(aArchetype.GetSignature() & ~aNewArchetype.GetSignature(), ObserverType::OnRemove, aEntity);
 
 		record.archetype = &aNewArchetype;
 		record.row = aNewRow;
@@ -348,20 +1009,20 @@ namespace ecs {
 			lastRow = aArchetype.GetLastRow();
 		}
 
-		std::vector<ecs::EntityID>& entities = aArchetype.GetEntityList();
+		std::pmr::vector<ecs::EntityID>& entities = aArchetype.GetEntityList();
 
 
 		if (sourceRow != lastRow)
 		{
 			ecs::EntityID entityToShuffle = aArchetype.GetEntity(lastRow);
-			ecs::Record& shuffleRecord = myEntityIndex.at(entityToShuffle);
+			ecs::Record& shuffleRecord = myEntityIndex.At(entityToShuffle);
 			shuffleRecord.row = sourceRow;
 			entities.at(shuffleRecord.row) = entities.at(lastRow);
 	
 			aArchetype.ShuffleEntity(lastRow, sourceRow);
 		}
 
-		entities.pop_back(); // the moved entity is guaranteed to be at the end at this point so just pop it, and decrease rowcount of the archetype.
+		aArchetype.RemoveLastEntity(); // the moved entity is guaranteed to be at the end at this point so just pop it, and decrease rowcount of the archetype.
 		//}
 	}
 
@@ -373,7 +1034,7 @@ namespace ecs {
 		os << "Max Count: " << aArchetype.GetMaxCount();
 		for (int i = 0; i < aArchetype.GetNumTypes(); i++)
 		{
-			os << aArchetype.GetComponentIDFromTypeList(i).name() << "\n";
+			os << ComponentRegistry::GetName(aArchetype.GetComponentIDFromTypeList(i)) << "\n";
 			os << "ElementSize:" << aArchetype.components[i].GetElementSize() << "\n";
 			os << "BufferSize:" << aArchetype.components[i].GetCapacity() << "\n";
 		}
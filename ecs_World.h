@@ -1,9 +1,11 @@
 #pragma once
 #include <cassert>
-#include <typeindex>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <bitset>
 #include <iostream>
 #include <memory>
@@ -12,9 +14,21 @@
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <span>
+#include <source_location>
+#include <numeric>
+#include <type_traits>
+#include <utility>
 #include "ComponentTypes.h"
 #include "System.h"
 #include "Archetype.h"
+#include "EntityIndex.h"
+#include "SparseSet.h"
+#include "CommandBuffer.h"
+#include "CachedQuery.h"
+#include "QueryTerms.h"
+#include "ThreadPool.h"
+#include "EventStream.h"
 #include "Ecs_Aliases.h"
 #include "CleanUpContainer.h"
 #define NOMINMAX
@@ -24,10 +38,14 @@ namespace ecs
 	class Entity;
 	class SystemManager;
 	class QueryIterator;
-	template<typename T>
-	inline ComponentID GetComponentID();
 	using CachedQueryHash = size_t;
 
+	/// <summary>
+	/// Tag for entities that only serve as a template for World::Instantiate.
+	/// Prefabs are left out of every query that doesn't ask for Prefab itself.
+	/// </summary>
+	struct Prefab {};
+
 
 	class World
 	{
@@ -35,7 +53,14 @@ namespace ecs
 		friend Archetype;
 		friend QueryIterator;
 		friend Stage;
-		World();
+		friend CommandBuffer;
+		friend CachedQuery;
+		/// <summary>
+		/// Creates a world where every internal container and component chunk is allocated from the given memory resource.
+		/// The resource has to outlive the world, backing it with an arena lets a whole level be freed at once.
+		/// </summary>
+		/// <param name="aMemoryResource">The memory resource to allocate from, defaults to the global heap.</param>
+		World(std::pmr::memory_resource* aMemoryResource = std::pmr::get_default_resource());
 		~World();
 
 		/// <summary>
@@ -55,6 +80,24 @@ namespace ecs
 		/// <returns>"True if entity was successfully destroyed, if the entity doesn't exist returns false"</returns>
 		bool DestroyEntity(ecs::EntityID id);
 
+		/// <summary>
+		/// Destroys every passed entity along with all it's components. Entities are grouped by archetype so each archetype
+		/// is compacted once and cached queries are invalidated once per archetype. Dead or repeated IDs are skipped.
+		/// </summary>
+		/// <param name="aEntities"> Entity IDs </param>
+		/// <returns>"The amount of entities destroyed"</returns>
+		size_t DestroyEntities(std::span<const EntityID> aEntities);
+
+		/// <summary>
+		/// Destroys every entity the matching FilteredQuery would return. Archetypes where every row matches are truncated
+		/// without looking at the rows.
+		/// </summary>
+		/// <param name="Components">The component types to match, template parameter packs like in Query.</param>
+		/// <param name="aFilters">An tuple filled with just the component types to leave alone. </param>
+		/// <returns>"The amount of entities destroyed"</returns>
+		template<typename... Components, typename... Filter>
+		size_t DestroyMatching(std::tuple<Filter...> aFilters = {});
+
 		/// <summary>
 		/// Get a Entity View class
 		/// </summary>
@@ -77,29 +120,113 @@ namespace ecs
 		bool HasComponent(EntityID e) const;
 
 		/// <summary>
-		/// Get Component from Entity.
+		/// Get Component from Entity. Counts as a write for Changed<T> queries, unless T is const, GetComponent<const T> only reads.
 		/// </summary>
 		/// <param name="e"> Entity ID </param>
 		/// <returns>"Returns pointer to component if it exists, else nullptr. If Component is a tag it will return nullptr "</returns>
 		template<typename T>
 		T* GetComponent(EntityID e);
 
+		/// <summary>
+		/// Get several Components from Entity, the entity is only looked up once. Counts as a write for Changed<T> queries to each of them that isn't const.
+		/// </summary>
+		/// <param name="e"> Entity ID </param>
+		/// <returns>"Returns a tuple with a pointer per component type, nullptr for the ones the entity doesn't have"</returns>
+		template<typename... Components>
+		std::tuple<Components*...> GetComponents(EntityID e);
+
 		/// <summary>
 		/// Query for entities
+		/// Wrapping a component in Changed<T> or Added<T> only returns the entities where it was written to or added since the query last ran from the same line.
+		/// Every call site keeps its own last run tick, a helper calling Query for several systems shares one, use a MakeQuery per system there.
+		/// Writes the loop makes to the Changed components of the entity it is on count as its own and don't show up in its next run.
+		/// The other query terms work as well, e.g. Query<Position, Without<Dead>, AnyOf<Player, Enemy>>().
 		/// </summary>
 		/// <param name="Components">The component types to query for. These are template parameter packs, not runtime parameters.</param>
+		/// <param name="aCallSite">Identifies the caller for Changed and Added terms, leave it defaulted.</param>
 		/// <returns>"Returns an range based iterator with all entities of specified types."</returns>
 		template<typename... Components>
-		QueryIterator Query();
+		QueryIterator Query(std::source_location aCallSite = std::source_location::current());
 
 		/// <summary>
-		/// Query for entities
+		/// Makes a query that can be kept across frames, e.g. world.MakeQuery<Position, Velocity>().Without<Dead>().
+		/// Its archetype list is built on first use and only grows when a new matching archetype is created.
+		/// </summary>
+		/// <param name="Components">The component types to query for.</param>
+		/// <returns>"Returns a CachedQuery that can be iterated with range for, any number of times"</returns>
+		template<typename... Components>
+		CachedQuery MakeQuery();
+
+		/// <summary>
+		/// Shows how a query is matched without caching it: which component the candidate archetypes are taken from,
+		/// how many archetypes are tested and match and how common every required component is.
+		/// </summary>
+		/// <param name="Terms">The query terms, the same as for Query.</param>
+		template<typename... Terms>
+		QueryPlan ExplainQuery();
+
+		/// <summary>
+		/// Calls aFunction for every entity matching Terms, handing it the components directly,
+		/// e.g. world.Each<Position, const Velocity, Optional<Health>, Without<Frozen>>([](Position& aPosition, const Velocity& aVelocity, Health* aHealth) {...}).
+		/// Plain components, Changed<T> and Added<T> are handed out as references, Optional<T> as a pointer that is nullptr when the entity doesn't have it,
+		/// With, Without, AnyOf and OneOf only filter and aren't handed out.
+		/// Columns are resolved once per archetype chunk so no lookups happen per entity. The function may take the EntityID first.
+		/// Every row visited counts as a write to the components that aren't const, so components the function only reads are declared const,
+		/// taking a component that isn't const by const reference or by value doesn't compile. Changed and Added terms keep their last run tick per call site, the same as in Query.
+		/// Don't add, remove or destroy from inside the function, record those in the command buffer instead.
+		/// </summary>
+		/// <param name="Terms">The query terms, const types are handed out as const references.</param>
+		/// <param name="aFunction">Called with the arguments of the terms, optionally preceded by the EntityID.</param>
+		/// <param name="aCallSite">Identifies the caller for Changed and Added terms, leave it defaulted.</param>
+		template<typename... Terms, typename Function>
+		void Each(Function&& aFunction, std::source_location aCallSite = std::source_location::current());
+
+		/// <summary>
+		/// Each split into row ranges that run on the worlds thread pool, returns when every range is done.
+		/// The function is called concurrently so it has to be callable through a const reference, and components it only reads
+		/// have to be declared const, e.g. world.ParallelEach<Position, const Velocity>(...), writing to those doesn't compile.
+		/// Like in Each every row visited counts as a write to the components that aren't const.
+		/// Structural changes go through GetCommandBuffer, every thread records into its own buffer.
+		/// </summary>
+		/// <param name="Terms">The query terms, same as for Each.</param>
+		/// <param name="aFunction">Called with the arguments of the terms, optionally preceded by the EntityID.</param>
+		/// <param name="aGrainSize">Rows per range, 0 uses one chunk per range.</param>
+		/// <param name="aCallSite">Identifies the caller for Changed and Added terms, leave it defaulted.</param>
+		template<typename... Terms, typename Function>
+		void ParallelEach(const Function& aFunction, size_t aGrainSize = 0, std::source_location aCallSite = std::source_location::current());
+
+		/// <summary>
+		/// Calls aFunction once per archetype chunk with a span over each requested column, for hand written SIMD or loops the compiler
+		/// can vectorize, e.g. world.ForEachChunk<Position, const Velocity>([](std::span<Position> aPositions, std::span<const Velocity> aVelocities) {...}).
+		/// Every span of a call has the same length and covers the same rows, a chunk with disabled components is split into the runs of rows that are enabled.
+		/// The function may take a std::span<const EntityID> of the rows first. Tags get an empty span and sparse components can't be requested.
+		/// Every row handed out counts as a write to the components that aren't const, taking a span of const for one of them doesn't compile.
+		/// </summary>
+		/// <param name="Components">The component types to iterate, const types are handed out as spans of const.</param>
+		/// <param name="aFunction">Called with (std::span<Components>...) or (std::span<const EntityID>, std::span<Components>...).</param>
+		template<typename... Components, typename Function>
+		void ForEachChunk(Function&& aFunction);
+
+		/// <summary>
+		/// The pool ParallelEach runs on, started the first time it's needed.
+		/// </summary>
+		ThreadPool& GetThreadPool();
+
+		/// <summary>
+		/// Tick that writes are stamped with right now. It moves on every time a query with Changed or Added terms is iterated,
+		/// so the query sees everything written after it started and nothing it has already seen from the same call site.
+		/// </summary>
+		ChangeTick GetChangeTick() const;
+
+		/// <summary>
+		/// Query for entities, Components takes the same query terms as Query.
 		/// </summary>
 		/// <param name="Components">The component types to query for. These are template parameter packs, not runtime parameters.</param>
 		/// <param name="filters">An tuple filled with just the component types to filter out from the query. </param>
+		/// <param name="aCallSite">Identifies the caller for Changed and Added terms, leave it defaulted.</param>
 		/// <returns>"Returns an range based iterator with all entities of specified types."</returns>
 		template<typename... Components, typename... Filter>
-		inline QueryIterator FilteredQuery(std::tuple<Filter...> aFilters);
+		inline QueryIterator FilteredQuery(std::tuple<Filter...> aFilters, std::source_location aCallSite = std::source_location::current());
 
 
 		/// <summary>
@@ -126,6 +253,83 @@ namespace ecs
 		template<typename T>
 		void RemoveComponent(EntityID e);
 
+		/// <summary>
+		/// Add several Components to Entity with a single move, the entity goes straight to the final archetype
+		/// without passing through the archetypes in between. Components the entity already has are left untouched.
+		/// </summary>
+		/// <param name="e"> Entity ID </param>
+		/// <returns>"Returns a tuple with a pointer per component type, nullptr for tags"</returns>
+		template<typename... Components>
+		std::tuple<Components*...> AddComponents(EntityID e);
+
+		/// <summary>
+		/// Remove several Components from Entity with a single move.
+		/// </summary>
+		/// <param name="e"> Entity ID </param>
+		template<typename... Components>
+		void RemoveComponents(EntityID e);
+
+		/// <summary>
+		/// Creates aCount entities straight in the archetype of Components with every component default constructed.
+		/// Chunks and entity slots are reserved once for the whole batch and no entity is moved between archetypes.
+		/// </summary>
+		/// <param name="aCount"> Amount of entities to create </param>
+		/// <returns>"Returns the IDs of the new entities, the span is valid until the next call to CreateBatch or Instantiate"</returns>
+		template<typename... Components>
+		std::span<const EntityID> CreateBatch(size_t aCount);
+
+		/// <summary>
+		/// Marks the entity as a prefab, it keeps all it's components but stops showing up in queries.
+		/// </summary>
+		/// <param name="aEntity"> Entity ID </param>
+		void MakePrefab(EntityID aEntity);
+
+		/// <summary>
+		/// Creates aCount copies of the prefab without the Prefab tag. Every column is filled straight from the prefab row,
+		/// trivial components with memcpy and the rest with their copy constructor.
+		/// </summary>
+		/// <param name="aPrefab"> Entity ID of the prefab, any living entity works </param>
+		/// <param name="aCount"> Amount of copies </param>
+		/// <returns>"Returns the IDs of the new entities, the span is valid until the next call to CreateBatch or Instantiate"</returns>
+		std::span<const EntityID> Instantiate(EntityID aPrefab, size_t aCount);
+
+		/// <summary>
+		/// Capacity hint, makes room for aCount more entities in the archetype of Components.
+		/// </summary>
+		/// <param name="aCount"> Amount of entities to make room for </param>
+		template<typename... Components>
+		void Reserve(size_t aCount);
+
+		/// <summary>
+		/// Returns the command buffer of the calling thread, structural changes recorded into it are applied at the next FlushCommands.
+		/// The buffer is created the first time a thread asks for it and recording into it never locks.
+		/// </summary>
+		CommandBuffer& GetCommandBuffer();
+
+		/// <summary>
+		/// Plays back the command buffers of every thread in one pass, entities are grouped so each one is moved at most once
+		/// and the moves are sorted by source and target archetype. Runs automatically between the pipeline phases in Progress.
+		/// </summary>
+		void FlushCommands();
+
+		/// <summary>
+		/// Stores components of type T in a sparse set outside of the archetypes. Adding and removing a sparse component
+		/// never moves the entity, use it for components that are toggled often. Has to be called before any entity has the component.
+		/// </summary>
+		template<typename T>
+		void RegisterSparseComponent();
+
+		/// <summary>
+		/// Check if a component type is kept in sparse set storage.
+		/// </summary>
+		bool IsSparseComponent(ComponentID aComponentID) const;
+
+		/// <summary>
+		/// Checks the sparse part of a query for one entity.
+		/// </summary>
+		/// <returns>"Returns true if the entity has every sparse component in aRequired and none in aExcluded"</returns>
+		bool MatchesSparseComponents(EntityID aEntity, const ComponentMask& aRequired, const ComponentMask& aExcluded) const;
+
 		/// <summary>
 		/// Sets a component of type <typeparamref name="T"/> for the specified entity.
 		/// </summary>
@@ -160,9 +364,38 @@ namespace ecs
 		template<typename T, typename Func>
 		void Observe(EntityID aEntity, Func&& aFunc, ObserverType aType);
 
+		/// <summary>
+		/// Subscribes to every aType event of component T, e.g. world.Observe<Health>(ObserverType::OnSet, [](std::span<const EntityID> aEntities) {...}).
+		/// Adds, removes and Set calls are recorded as they happen and handed over in one call per pipeline phase by DispatchEvents.
+		/// An entity is in the span once per event and may have been destroyed since. Components nobody subscribes to are never recorded.
+		/// Subscribing from inside a subscriber isn't allowed.
+		/// </summary>
+		/// <param name="aType">The kind of event to subscribe to.</param>
+		/// <param name="aFunc">Called with a std::span<const EntityID> of the entities the events happened to, in the order they happened.</param>
+		template<typename T, typename Func>
+		void Observe(ObserverType aType, Func&& aFunc);
+
+		/// <summary>
+		/// Hands the events recorded since the last dispatch to their subscribers. Runs after FlushCommands between the pipeline phases in Progress.
+		/// </summary>
+		void DispatchEvents();
+
+		/// <summary>
+		/// Enables or disables a component on an entity without moving it, queries skip entities where a queried component is disabled.
+		/// The component keeps its data and can still be fetched with GetComponent.
+		/// </summary>
+		/// <param name="aEntityID"> Entity ID </param>
+		/// <param name="isEnabled"> False to disable the component </param>
 		template<typename T>
 		void EnableComponent(ecs::EntityID aEntityID, bool isEnabled);
 
+		/// <summary>
+		/// Check if a component on an entity is enabled.
+		/// </summary>
+		/// <returns>"Returns false if the component is disabled or the entity doesn't have it"</returns>
+		template<typename T>
+		bool IsComponentEnabled(ecs::EntityID aEntityID) const;
+
 		/// <summary>
 		/// Clears the entire Entity Component System (ECS), removing all entities and components.
 		/// </summary>
@@ -201,6 +434,26 @@ namespace ecs
 		/// </summary>
 		void Quit();
 
+		/// <summary>
+		/// Sets the policy deciding when archetypes give back chunks they no longer use. 
+		/// The policy is evaluated once per frame at the end of Progress.
+		/// </summary>
+		/// <param name="aPolicy">Occupancy threshold, amount of frames and chunks to keep before memory is released.</param>
+		void SetMemoryReclaimPolicy(const MemoryReclaimPolicy& aPolicy);
+
+		/// <summary>
+		/// Immediately releases every chunk that holds no rows and shrinks the entity lists, regardless of the reclaim policy.
+		/// </summary>
+		/// <returns>
+		/// The amount of chunk memory in bytes that was released.
+		/// </returns>
+		size_t TrimMemory();
+
+		/// <summary>
+		/// Returns the amount of chunk memory in bytes currently allocated by all archetypes.
+		/// </summary>
+		size_t GetResidentMemory() const;
+
 		/// <summary>
 		/// Retrieves a view-only pointer to the archetype associated with the specified entity.
 		/// </summary>
@@ -245,20 +498,116 @@ namespace ecs
 
 		
 		
-		void CreateStage(std::string& aStageName);
+		/// <summary>
+		/// Returns the memory resource all of the worlds allocations are drawn from.
+		/// </summary>
+		std::pmr::memory_resource* GetMemoryResource() const;
+
+		/// <summary>
+		/// Creates a stage with the given name, the stage allocates from aMemoryResource or from the worlds resource if none is given.
+		/// </summary>
+		void CreateStage(std::string& aStageName, std::pmr::memory_resource* aMemoryResource = nullptr);
 		Stage* GetStage(std::string& aStageName);
 	protected:
 		/// <summary>
-		/// Invalidates a cached query by its associated hash, ensuring that future queries are recalculated.
+		/// Adds a newly created archetype to the flat archetype and signature tables used for query matching,
+		/// and to every query cache it matches.
+		/// </summary>
+		void RegisterArchetype(Archetype& aArchetype);
+
+		void RegisterSparseComponent(ComponentID aComponentID);
+
+		/// <summary>
+		/// Finds the archetype for a sorted list of component ids, creating it from the registered type infos if it doesn't exist yet.
+		/// </summary>
+		Archetype& GetOrCreateArchetype(const Type& aType);
+
+		/// <summary>
+		/// Adds the archetype to the list of archetypes that are cleared on level load, unless it is marked DontDestroyOnLoad.
+		/// </summary>
+		void TrackClearOnLoad(Archetype& aArchetype);
+
+		/// <summary>
+		/// Removes an entity from every sparse set, used when the entity is destroyed.
+		/// </summary>
+		void RemoveSparseComponents(EntityID aEntity);
+
+		/// <summary>
+		/// Destroys the entities grouped by archetype, skipping dead or repeated IDs. Expects myMutex to be held.
+		/// </summary>
+		size_t DestroyEntityList(std::span<const EntityID> aEntities);
+
+		//Destroys the sorted rows of one archetype and fixes the records of the entities moved into the holes.
+		void DestroyArchetypeRows(Archetype& aArchetype, std::span<const size_t> aRows);
+
+		/// <summary>
+		/// Finds the cache for the given components, matching it against every archetype the first time it's asked for.
+		/// Expects myMutex to be held.
+		/// </summary>
+		QueryCache& GetQueryCache(const QueryTerms& aTerms);
+
+		/// <summary>
+		/// Starts a run of a query with change filters. Returns the tick the query last ran at, rows written after it pass the filters.
+		/// aLastRunTick is set to a tick reserved for this run and the world tick moves past it,
+		/// so writes the run stamps with aLastRunTick are left out of the next run while every write after it is seen.
+		/// </summary>
+		ChangeTick AdvanceChangeTick(ChangeTick& aLastRunTick);
+
+		//Stamps a write to a component of the row, sparse components and tags have no ticks and are left alone
+		void MarkChanged(Archetype& aArchetype, ComponentID aComponentID, size_t aRow);
+
+		/// <summary>
+		/// Splits the cache into dense and sparse components and refills its archetype list.
+		/// </summary>
+		void BuildQueryCache(QueryCache& aCache) const;
+
+		//Runs the Each function over rows [aFirstRow, aLastRow) of one archetype. aChangedSince and aRunTick are only used when the terms have change filters,
+		//rows written by the run are then stamped with aRunTick so the next run doesn't see them as changed
+		template<typename... Terms, typename Function>
+		void EachRows(Function& aFunction, const QueryCache& aCache, Archetype& aArchetype, size_t aFirstRow, size_t aLastRow, ChangeTick aChangedSince, ChangeTick aRunTick);
+
+		//Calls aFunction for every row in [aFirstRow, aLastRow) where all of aRequired are enabled, the enable bits are fetched once per 64 rows
+		template<typename Function>
+		static void ForEachEnabledRow(const Archetype& aArchetype, const ComponentMask& aRequired, size_t aFirstRow, size_t aLastRow, Function&& aFunction);
+
+		//Span handed to ForEachChunk, empty for tags
+		template<typename T>
+		static std::span<T> GetChunkSpan(std::byte* aChunk, size_t aOffset, size_t aCount);
+
+		//Component handed to Each for one row, aChunk is the column slice of the row's chunk or nullptr for tags and sparse components
+		template<typename T>
+		T& GetEachComponent(std::byte* aChunk, size_t aOffset, EntityID aEntity);
+
+		//Arguments one query term hands to Each for one row, nothing for pure filters
+		template<typename Term>
+		typename QueryTerm<Term>::Argument GetEachArgument(std::byte* aChunk, size_t aOffset, EntityID aEntity, const Archetype& aArchetype, size_t aRow);
+
+		/// <summary>
+		/// Collects every archetype the cache matches.
+		/// Candidates come from the archetype map of the rarest required component and the other required components are tested rarest first.
+		/// Without required components the signatures are scanned as one contiguous array so the mask tests vectorize across archetypes.
 		/// </summary>
-		/// <param name="aHash">The hash of the cached query to invalidate.</param>
-		void InvalidateCachedQueryFromMove(Archetype* oldArchetype, Archetype* newArchetype);
+		void MatchArchetypes(const QueryCache& aCache, std::pmr::vector<Archetype*>& outArchetypes) const;
+
+		//Component of aRequired that is in the fewest archetypes, every match is in its archetype map. ECS_COMPONENT_NULL when aRequired is empty
+		ComponentID GetSeedComponent(const ComponentMask& aRequired) const;
+
+		//Entities that have the component, kept up to date by the archetypes as rows come and go
+		size_t GetNumEntitiesWith(ComponentID aComponentID) const;
+
+		QueryPlan ExplainQuery(const QueryTerms& aTerms) const;
+
+		/// <summary>
+		/// Applies the memory reclaim policy to every archetype, releasing chunks of archetypes that stayed under occupied.
+		/// </summary>
+		void ReclaimMemory();
 
 		template<typename... args>
 		const Archetype* GetArchetype() const;
 
 		/// <summary>
-		/// Generates a new unique entity ID.
+		/// Generates a new entity ID, reusing the slot of a destroyed entity with its generation bumped.
+		/// A stage takes its ids from the world it merges into so they never collide there.
 		/// </summary>
 		/// <returns>
 		/// A unique `entity` ID that can be used to identify an entity in the ECS.
@@ -267,6 +616,9 @@ namespace ecs
 
 		ecs::ArchetypeID GenerateArchetypeID();
 
+		//Generates aCount ids and adds them as rows [aFirstRow, aFirstRow + aCount) of aArchetype, appending them to myCreatedBatch
+		void AddBatchEntities(Archetype& aArchetype, size_t aFirstRow, size_t aCount);
+
 		/// <summary>
 		/// Derives a new archetype from the source archetype.
 		/// </summary>
@@ -281,88 +633,146 @@ namespace ecs
 		template<typename T>
 		void InvokeObserverCallbacks(EntityID aEntity, ObserverType aType);
 
-		template<typename T>
-		ComponentTypeInfo RegisterComponent();
+		//Records the event if anything subscribes to it, a bit test is all it costs otherwise
+		void RecordEvent(ComponentID aComponentID, ObserverType aType, EntityID aEntity);
+
+		//Records aType for every component in aComponents
+		void RecordEvents(const ComponentMask& aComponents, ObserverType aType, EntityID aEntity);
+
+		//Records aType for every component of rows [aFirstRow, aLastRow)
+		void RecordRowEvents(Archetype& aArchetype, size_t aFirstRow, size_t aLastRow, ObserverType aType);
+
+		//An entity FlushCommands moves once, folding every add and remove recorded for it into one target archetype
+		struct PendingMove
+		{
+			EntityID entity;
+			Archetype* source;
+			Archetype* target;
+			size_t firstCommand;
+			size_t lastCommand;
+		};
+
+		//Rows [firstRow, lastRow) of an archetype, one task of ParallelEach
+		struct RowRange
+		{
+			Archetype* archetype;
+			size_t firstRow;
+			size_t lastRow;
+		};
+
+		//Takes an empty range buffer from myRowRangeBuffers, or a new one if every buffer is in use
+		std::pmr::vector<RowRange> AcquireRowRanges();
+
+		//Clears the buffer and hands it back to myRowRangeBuffers
+		void ReleaseRowRanges(std::pmr::vector<RowRange>&& aRanges);
+
+		//A row DestroyEntities removes, sorted by archetype so each archetype is compacted once
+		struct Victim
+		{
+			Archetype* archetype;
+			size_t row;
+		};
 
 		std::mutex myEntityGenerationMutex;
+		World* myIDSource = this; //World whose entity index hands out the ids, the owning world for a stage
+		std::mutex myCommandBufferMutex;
 		std::mutex myArchetypeGenerationMutex;
 		std::mutex myMutex;
-		ecs::EntityID myNextEntity = 1;
-		std::unordered_map<ComponentID, ArchetypeMap> myComponentIndex; // Used to lookup components in archetypes
-		std::unordered_map<Type, Archetype, TypeHash, TypeEqual> myArchetypeIndex; // Find an archetype by its list of component ids
-		EntityIndex myEntityIndex;		// Find the archetype for an entity
-		std::unordered_map<CachedQueryHash, std::vector<Archetype*>> myCachedQueries;
-		
-		std::unordered_map<ArchetypeID, std::unordered_set<CachedQueryHash>> myArchetypeToQueries;
-
-		std::unordered_map<ArchetypeID, size_t> myClearOnLoadIndex;
-		std::vector<const Type*> myClearOnLoadArchetypeList;
-		std::vector<ArchetypeID> myClearOnLoadArchetypeIDList;
+		std::pmr::memory_resource* myMemoryResource; //Everything below that allocates draws from this resource
+		ComponentIndex myComponentIndex; // Used to lookup components in archetypes
+		ArchetypeIndex myArchetypeIndex; // Find an archetype by its list of component ids
+		EntityIndex myEntityIndex;		// Find the archetype for an entity, generational slot map indexed by entity index
+		std::pmr::vector<Archetype*> myArchetypeTable; // Indexed by ArchetypeID
+		std::pmr::vector<ComponentMask> myArchetypeSignatures; // Indexed by ArchetypeID, kept apart so matching walks contiguous masks
+		std::pmr::vector<size_t> myComponentEntityCounts; // Indexed by component id, rows in the archetypes that have the component. The archetypes keep it up to date
+		ComponentMask mySparseComponents; // Component ids registered for sparse storage
+		std::pmr::vector<SparseSet> mySparseSets; // Indexed by component id, grown when a sparse component is registered
+		std::pmr::unordered_multimap<CachedQueryHash, QueryCache> myCachedQueries; // Nodes never move, CachedQuery keeps pointers to them
+
+		std::pmr::unordered_map<ArchetypeID, size_t> myClearOnLoadIndex;
+		std::pmr::vector<const Type*> myClearOnLoadArchetypeList;
+		std::pmr::vector<ArchetypeID> myClearOnLoadArchetypeIDList;
+		MemoryReclaimPolicy myMemoryReclaimPolicy;
 		
 		std::unordered_map<std::string,std::unique_ptr<Stage>> myStages;
 		ObserverMap myObserverIndex;
+		std::pmr::vector<EventStream> myEventStreams; // Indexed by component id * ECS_OBSERVER_TYPE_COUNT + observer type, grown when a component is observed
+		std::array<ComponentMask, ECS_OBSERVER_TYPE_COUNT> myObservedComponents; // Indexed by observer type, components with a subscribed stream
+		std::mutex myEventMutex; // Only taken to record events of observed components
+		bool myIsDispatchingEvents = false;
 		std::unique_ptr<SystemManager> mySystems;
+		std::pmr::vector<std::unique_ptr<CommandBuffer>> myCommandBuffers; // One per thread that recorded into this world
+		const uint64_t myWorldID; // Unique for the whole run, keys the thread local command buffer lookup
+		std::pmr::vector<EntityID> myCreatedBatch; // IDs returned by the last CreateBatch
+		std::pmr::vector<const CommandBuffer::Command*> myFlushCommands; // Scratch for FlushCommands, cleared per flush so it only grows to the largest flush
+		std::pmr::vector<PendingMove> myFlushMoves; // Scratch for FlushCommands
+		std::pmr::vector<EntityID> myFlushDestroyed; // Scratch for FlushCommands
+		std::pmr::vector<Victim> myDestroyVictims; // Scratch for DestroyEntities, used under myMutex
+		std::pmr::vector<size_t> myDestroyRows; // Scratch for DestroyEntities and DestroyMatching, used under myMutex
+		std::unique_ptr<ThreadPool> myThreadPool; // Started on first use so worlds and stages that never run in parallel don't spawn threads
+		std::once_flag myThreadPoolOnce;
+		std::mutex myRowRangeMutex;
+		std::pmr::vector<std::pmr::vector<RowRange>> myRowRangeBuffers; // Free range buffers of ParallelEach, one per call that ran at the same time
+		std::atomic<ChangeTick> myChangeTick{ 1 }; // Stamped into the archetypes on writes, 0 is left for never
 	};
 
 	template<typename T>
 	void World::InvokeObserverCallbacks(EntityID aEntity, ObserverType aType)
 	{
-		ObserverRecord& observerRecord = myObserverIndex.at(GetComponentID<T>());
-		ObserverLists& observerLists = observerRecord.at(aEntity);
-		ObserverList& list = observerLists.at(aType);
-		for (std::function<void()>& func : list)
+		ObserverRecord& observerRecord = myObserverIndex[GetComponentID<T>()];
+		if (observerRecord.empty()) return;
+
+		auto observerLists = observerRecord.find(aEntity);
+		if (observerLists == observerRecord.end()) return;
+		auto list = observerLists->second.find(aType);
+		if (list == observerLists->second.end()) return;
+
+		for (std::function<void()>& func : list->second)
 		{
 			func();
 		}
 	}
 
-	template<typename T>
-	inline ComponentTypeInfo World::RegisterComponent()
+	template <typename ... args>
+	const Archetype* World::GetArchetype() const
 	{
-		ComponentTypeInfo typeInfo;
-
-		typeInfo.size = sizeof(T);
-		typeInfo.alignment = alignof(T);
-		typeInfo.typeID = typeid(T);
-
-		// Default constructor
-		typeInfo.construct = std::is_default_constructible_v<T> ?
-			[](void* dest) { new (dest) T(); } : nullptr;
-
-		// Copy constructor
-		typeInfo.copy = std::is_copy_constructible_v<T> ?
-			[](void* dest, const void* src) { new (dest) T(*reinterpret_cast<const T*>(src)); } : nullptr;
-
-		// Move constructor
-		typeInfo.move = std::is_move_constructible_v<T> ?
-			[](void* dest, void* src) { new (dest) T(std::move(*reinterpret_cast<T*>(src))); } : nullptr;
-
-		// Destructor
-		typeInfo.destruct = std::is_destructible_v<T> ?
-			[](void* obj) { reinterpret_cast<T*>(obj)->~T(); } : nullptr;
-
-		//Trivial copyable check
-		typeInfo.isTrivial = std::is_trivially_copyable_v<T>;
+		Type componentTypes = { GetComponentID<args>()... };
+		std::sort(componentTypes.begin(), componentTypes.end());
+		auto it = myArchetypeIndex.find(componentTypes);
+		if (it == myArchetypeIndex.end()) { return nullptr; }
 
-		return typeInfo;
+		return &it->second;
 	}
 
-	template <typename ... args>
-	const Archetype* World::GetArchetype() const
+	inline bool World::IsSparseComponent(ComponentID aComponentID) const
 	{
-		Type componentTypes = { std::type_index(typeid(args))... };
-		std::sort(componentTypes.begin(), componentTypes.end());
-		if (myArchetypeIndex.contains(componentTypes) == 0) { return nullptr; }
+		return mySparseComponents.test(aComponentID);
+	}
 
-		return &myArchetypeIndex[componentTypes];
+	template<typename T>
+	inline void World::RegisterSparseComponent()
+	{
+		RegisterSparseComponent(GetComponentID<T>());
 	}
 
 	template<typename T>
 	inline bool World::HasComponent(EntityID e) const
 	{
-		assert(myEntityIndex.contains(e), "I CANT BELIEVE YOU'VE DONE THIS.");
+		assert(myEntityIndex.Contains(e), "I CANT BELIEVE YOU'VE DONE THIS.");
+
+		const ComponentID componentID = GetComponentID<T>();
+		if (IsSparseComponent(componentID)) return mySparseSets[componentID].Contains(e);
 
-		return myEntityIndex.at(e).archetype->Contains(std::tuple<T>());
+		return myEntityIndex.At(e).archetype->Contains(std::tuple<T>());
+	}
+
+	inline void World::MarkChanged(Archetype& aArchetype, ComponentID aComponentID, size_t aRow)
+	{
+		const int slot = aArchetype.FindTypeIndex(aComponentID);
+		if (slot >= 0 && !ComponentRegistry::GetTypeInfo(aComponentID).isTag)
+		{
+			aArchetype.SetChangedTick(slot, aRow, GetChangeTick());
+		}
 	}
 
 	template <typename T>
@@ -370,136 +780,455 @@ namespace ecs
 	{
 		static_assert(!std::is_empty<T>::value); //You cannot fetch tags! what you want to use is HasComponent<Tag>();
 
-		if (!myEntityIndex.contains(e)) return nullptr;
-		Record& record = myEntityIndex.at(e);
-		if (!record.archetype->HasComponent(GetComponentID<T>())) return nullptr;
-		ArchetypeMap& archetypeMap = myComponentIndex[GetComponentID<T>()];
-		if (archetypeMap.count(record.archetype->GetID()) == 0) return nullptr;
+		const ComponentID componentID = GetComponentID<T>();
+		if (IsSparseComponent(componentID)) return static_cast<T*>(mySparseSets[componentID].Get(e));
+
+		Record* record = myEntityIndex.Find(e);
+		if (!record) return nullptr;
+		assert(record->archetype->GetEntityList().at(record->row) == e);
 
-		ArchetypeRecord& archetypeRecord = archetypeMap[record.archetype->GetID()];
+		if constexpr (!std::is_const_v<T>) MarkChanged(*record->archetype, componentID, record->row);
+		return static_cast<T*>(record->archetype->GetComponent(componentID, record->row));
+	}
 
-		assert(record.archetype->GetID() == archetypeRecord.archetype->GetID());
-		assert(record.archetype->GetEntityList().at(record.row) == e);
+	template<typename... Components>
+	inline std::tuple<Components*...> World::GetComponents(EntityID e)
+	{
+		static_assert((!std::is_empty<Components>::value && ...)); //Tags have no data, use HasComponent<Tag>();
 
+		Record* record = myEntityIndex.Find(e);
+		if (!record) return std::tuple<Components*...>();
+		assert(record->archetype->GetEntityList().at(record->row) == e);
 
-		T* component = static_cast<T*>(record.archetype->GetColumn(archetypeRecord.columnIndex)->GetComponent(record.row));
-		return component;
+		Archetype* archetype = record->archetype;
+		const size_t row = record->row;
+		auto fetch = [&](ComponentID aComponentID, bool isWritten) -> void*
+			{
+				if (IsSparseComponent(aComponentID)) return mySparseSets[aComponentID].Get(e);
+				if (isWritten) MarkChanged(*archetype, aComponentID, row);
+				return archetype->GetComponent(aComponentID, row);
+			};
+		return std::tuple<Components*...>(static_cast<Components*>(fetch(GetComponentID<Components>(), !std::is_const_v<Components>))...);
 	}
 
 	template <typename ... Components>
-	QueryIterator World::Query()
+	QueryIterator World::Query(std::source_location aCallSite)
 	{
 		std::lock_guard<std::mutex> lock(myMutex);
-		Type types = { std::type_index(typeid(Components))... };
-		std::sort(types.begin(), types.end());
-		size_t hash = 0;
-		for (auto& type : types)
+		const QueryTerms terms = MakeQueryTerms<Components...>();
+
+		QueryCache& cache = GetQueryCache(terms);
+		ChangeTick changedSince = 0;
+		ChangeTick runTick = 0;
+		if (terms.HasChangeFilter())
 		{
-			JPH::HashCombine(hash, type.hash_code());
+			ChangeTick& lastRunTick = cache.GetLastRunTick(aCallSite);
+			changedSince = AdvanceChangeTick(lastRunTick);
+			runTick = lastRunTick;
 		}
+		return QueryIterator(this, cache.archetypes, cache.denseRequired, cache.sparseRequired, cache.sparseExcluded, terms.changed, terms.added, changedSince, runTick);
+	}
+
 
-		//if (myCachedQueries.contains(hash))
-		//{
-		//	return QueryIterator(this, myCachedQueries.at(hash));
-		//}
+	template<typename... Components>
+	inline CachedQuery World::MakeQuery()
+	{
+		return CachedQuery(this, MakeQueryTerms<Components...>());
+	}
 
-		std::unordered_set<Archetype*> archetypeSet;
-		if (!myComponentIndex.contains(types[0]))
+	template<typename... Terms>
+	inline QueryPlan World::ExplainQuery()
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		return ExplainQuery(MakeQueryTerms<Terms...>());
+	}
+
+	template<typename... Terms, typename Function>
+	inline void World::Each(Function&& aFunction, std::source_location aCallSite)
+	{
+		using Arguments = EachArguments<Terms...>;
+		using ArgumentsWithEntity = decltype(std::tuple_cat(std::tuple<EntityID>(), std::declval<Arguments>()));
+		static_assert(IsInvocableWith<Function&, Arguments>::value || IsInvocableWith<Function&, ArgumentsWithEntity>::value,
+			"Each expects a function taking the arguments of the terms, optionally preceded by the EntityID");
+		static_assert(TakesMutableTermsWritable<Function, Terms...>(),
+			"Each stamps every row it visits as written to the components that aren't const in Terms, declare the ones the function only reads const");
+
+		const QueryTerms terms = MakeQueryTerms<Terms...>();
+		const QueryCache* cache = nullptr;
+		ChangeTick changedSince = 0;
+		ChangeTick runTick = 0;
 		{
-			return QueryIterator();
+			std::lock_guard<std::mutex> lock(myMutex);
+			QueryCache& queryCache = GetQueryCache(terms);
+			if (terms.HasChangeFilter())
+			{
+				ChangeTick& lastRunTick = queryCache.GetLastRunTick(aCallSite);
+				changedSince = AdvanceChangeTick(lastRunTick);
+				runTick = lastRunTick;
+			}
+			cache = &queryCache;
 		}
 
-		auto& archetypeMap = myComponentIndex.at(types[0]);
-		for (const auto& record : archetypeMap)
+		//Walked by index, the list grows if the function ends up creating an archetype
+		for (size_t archetypeIndex = 0; archetypeIndex < cache->archetypes.size(); archetypeIndex++)
+		{
+			Archetype* archetype = cache->archetypes[archetypeIndex];
+			EachRows<Terms...>(aFunction, *cache, *archetype, 0, archetype->GetNumEntities(), changedSince, runTick);
+		}
+	}
+
+	template<typename... Terms, typename Function>
+	inline void World::ParallelEach(const Function& aFunction, size_t aGrainSize, std::source_location aCallSite)
+	{
+		using Arguments = EachArguments<Terms...>;
+		using ArgumentsWithEntity = decltype(std::tuple_cat(std::tuple<EntityID>(), std::declval<Arguments>()));
+		static_assert(IsInvocableWith<const Function&, Arguments>::value || IsInvocableWith<const Function&, ArgumentsWithEntity>::value,
+			"ParallelEach expects a function taking the arguments of the terms, optionally preceded by the EntityID, that can be called through a const reference, "
+			"components that are only read must be declared const in Terms and taken by const reference");
+		static_assert(TakesMutableTermsWritable<Function, Terms...>(),
+			"ParallelEach stamps every row it visits as written to the components that aren't const in Terms, declare the ones the function only reads const");
+
+		const QueryTerms terms = MakeQueryTerms<Terms...>();
+		const QueryCache* cache = nullptr;
+		ChangeTick changedSince = 0;
+		ChangeTick runTick = 0;
 		{
-			size_t found = 1;
-			for (int i = 1; i < types.size(); i++)
+			std::lock_guard<std::mutex> lock(myMutex);
+			QueryCache& queryCache = GetQueryCache(terms);
+			if (terms.HasChangeFilter())
 			{
-				ComponentID type = types[i];
-				if (record.second.archetype->HasComponent(type))
-				{
-					found++;
-				}
-				else
+				ChangeTick& lastRunTick = queryCache.GetLastRunTick(aCallSite);
+				changedSince = AdvanceChangeTick(lastRunTick);
+				runTick = lastRunTick;
+			}
+			cache = &queryCache;
+		}
+
+		//Nested and concurrent calls each take their own buffer, the buffers keep their capacity between calls
+		std::pmr::vector<RowRange> ranges = AcquireRowRanges();
+		for (Archetype* archetype : cache->archetypes)
+		{
+			if (terms.HasChangeFilter() && !archetype->HasChangesSince(terms.changed, terms.added, changedSince)) continue;
+
+			const size_t numRows = archetype->GetNumEntities();
+			const size_t grainSize = aGrainSize ? aGrainSize : archetype->GetChunkCapacity();
+			for (size_t firstRow = 0; firstRow < numRows; firstRow += grainSize)
+			{
+				ranges.push_back(RowRange{ archetype, firstRow, std::min(numRows, firstRow + grainSize) });
+			}
+		}
+
+		GetThreadPool().ParallelFor(ranges.size(), [&](size_t aIndex)
+		{
+			const RowRange& range = ranges[aIndex];
+			EachRows<Terms...>(aFunction, *cache, *range.archetype, range.firstRow, range.lastRow, changedSince, runTick);
+		});
+		ReleaseRowRanges(std::move(ranges));
+	}
+
+	template<typename... Terms, typename Function>
+	inline void World::EachRows(Function& aFunction, const QueryCache& aCache, Archetype& aArchetype, size_t aFirstRow, size_t aLastRow, ChangeTick aChangedSince, ChangeTick aRunTick)
+	{
+		using ArgumentsWithEntity = decltype(std::tuple_cat(std::tuple<EntityID>(), std::declval<EachArguments<Terms...>>()));
+		constexpr bool withEntity = IsInvocableWith<Function&, ArgumentsWithEntity>::value;
+		if (aFirstRow >= aLastRow) return;
+
+		const QueryTerms& terms = aCache.terms;
+		const bool filterChanges = terms.HasChangeFilter();
+		if (filterChanges && !aArchetype.HasChangesSince(terms.changed, terms.added, aChangedSince)) return;
+
+		//Terms without a component, like With or AnyOf, get no column
+		const std::array<ComponentID, sizeof...(Terms)> componentIDs = { GetTermComponentID<Terms>()... };
+		std::array<Column*, sizeof...(Terms)> columns{};
+		for (size_t i = 0; i < componentIDs.size(); i++)
+		{
+			const int columnIndex = componentIDs[i] == ECS_COMPONENT_NULL ? -1 : aArchetype.FindColumnIndex(componentIDs[i]);
+			columns[i] = columnIndex < 0 ? nullptr : aArchetype.GetColumn(columnIndex);
+		}
+
+		//Type slots of the components handed out as mutable, every row visited is stamped as written
+		constexpr std::array<bool, sizeof...(Terms)> isWritten = { isMutableTerm<Terms>... };
+		std::array<int, sizeof...(Terms)> writtenSlots{};
+		for (size_t i = 0; i < writtenSlots.size(); i++)
+		{
+			writtenSlots[i] = isWritten[i] ? aArchetype.FindTypeIndex(componentIDs[i]) : -1;
+		}
+		const ChangeTick changeTick = filterChanges ? aRunTick : GetChangeTick();
+
+		const EntityID* entities = aArchetype.GetEntityList().data();
+		const bool hasSparseFilter = aCache.sparseRequired.any() || aCache.sparseExcluded.any();
+		const bool hasDisabledComponents = aArchetype.HasDisabledComponents();
+		const size_t rowsPerChunk = aArchetype.GetChunkCapacity();
+		for (size_t chunkStart = aFirstRow; chunkStart < aLastRow;)
+		{
+			const size_t chunk = chunkStart / rowsPerChunk;
+			const size_t chunkFirstRow = chunk * rowsPerChunk;
+			const size_t chunkEnd = std::min(aLastRow, chunkFirstRow + rowsPerChunk);
+
+			std::array<std::byte*, sizeof...(Terms)> chunks{};
+			for (size_t i = 0; i < columns.size(); i++)
+			{
+				chunks[i] = columns[i] ? columns[i]->GetChunk(chunk) : nullptr;
+			}
+
+			auto visitRow = [&](size_t row)
+			{
+				if (hasSparseFilter && !MatchesSparseComponents(entities[row], aCache.sparseRequired, aCache.sparseExcluded)) return;
+				if (filterChanges && !aArchetype.IsRowChangedSince(terms.changed, terms.added, row, aChangedSince)) return;
+
+				[&]<size_t... I>(std::index_sequence<I...>)
 				{
-					break;
+					if constexpr (withEntity)
+					{
+						std::apply(aFunction, std::tuple_cat(std::tuple<EntityID>(entities[row]), GetEachArgument<Terms>(chunks[I], row - chunkFirstRow, entities[row], aArchetype, row)...));
+					}
+					else
+					{
+						std::apply(aFunction, std::tuple_cat(GetEachArgument<Terms>(chunks[I], row - chunkFirstRow, entities[row], aArchetype, row)...));
+					}
+				}(std::index_sequence_for<Terms...>{});
 
+				for (int slot : writtenSlots)
+				{
+					if (slot >= 0) aArchetype.SetChangedTick(slot, row, changeTick);
 				}
-			}
+			};
 
-			if (found == types.size() && 0 < record.second.archetype->GetNumEntities())
+			if (!hasDisabledComponents)
 			{
-				archetypeSet.insert(record.second.archetype);
+				for (size_t row = chunkStart; row < chunkEnd; row++) visitRow(row);
 			}
+			else
+			{
+				ForEachEnabledRow(aArchetype, aCache.denseRequired, chunkStart, chunkEnd, visitRow);
+			}
+			chunkStart = chunkEnd;
 		}
+	}
 
-		if (!archetypeSet.empty())
+	template<typename Function>
+	inline void World::ForEachEnabledRow(const Archetype& aArchetype, const ComponentMask& aRequired, size_t aFirstRow, size_t aLastRow, Function&& aFunction)
+	{
+		for (size_t wordFirstRow = aFirstRow & ~size_t(63); wordFirstRow < aLastRow; wordFirstRow += 64)
 		{
-			std::vector<Archetype*> archetypeVector(archetypeSet.begin(), archetypeSet.end());
-			myCachedQueries.emplace(hash, archetypeVector);
-			for (auto* archetype : archetypeVector)
+			uint64_t enabledRows = aArchetype.GetEnabledRows(aRequired, wordFirstRow >> 6);
+			if (aFirstRow > wordFirstRow) enabledRows &= ~uint64_t(0) << (aFirstRow - wordFirstRow);
+			if (aLastRow < wordFirstRow + 64) enabledRows &= (uint64_t(1) << (aLastRow - wordFirstRow)) - 1;
+			while (enabledRows)
 			{
-				myArchetypeToQueries[archetype->GetID()].insert(hash);
+				aFunction(wordFirstRow + std::countr_zero(enabledRows));
+				enabledRows &= enabledRows - 1;
 			}
-			return QueryIterator(this, archetypeVector);
 		}
-
-		return QueryIterator();
 	}
 
-
-	template<typename ...Components, typename ...Filter>
-	inline QueryIterator World::FilteredQuery(std::tuple<Filter...> filters)
+	template<typename... Components, typename Function>
+	inline void World::ForEachChunk(Function&& aFunction)
 	{
-		std::lock_guard<std::mutex> lock(myMutex);
-		std::vector<Archetype*> archetypeArray;
+		constexpr bool withEntities = std::is_invocable_v<Function&, std::span<const EntityID>, std::span<Components>...>;
+		static_assert(withEntities || std::is_invocable_v<Function&, std::span<Components>...>,
+			"ForEachChunk expects a function taking (std::span<Components>...) or (std::span<const EntityID>, std::span<Components>...)");
+		static_assert(TakesMutableTermsWritable<Function, Components...>(),
+			"ForEachChunk stamps every row it visits as written to the components that aren't const, declare the ones the function only reads const");
 
-		Type types;
-		types = { std::type_index(typeid(Components))... };
-		std::sort(types.begin(), types.end());
-		if (!myComponentIndex.contains(types[0]))
+		const QueryCache* cache = nullptr;
 		{
-			return QueryIterator();
+			std::lock_guard<std::mutex> lock(myMutex);
+			cache = &GetQueryCache(MakeQueryTerms<Components...>());
 		}
-		auto& archetypeMap = myComponentIndex.at(types[0]);
-		for (const auto& record : archetypeMap)
+		assert(cache->sparseRequired.none(), "Sparse components aren't stored in chunks, use Each to iterate them");
+
+		const std::array<ComponentID, sizeof...(Components)> componentIDs = { GetComponentID<Components>()... };
+		for (size_t archetypeIndex = 0; archetypeIndex < cache->archetypes.size(); archetypeIndex++)
 		{
-			if (record.second.archetype->Contains(filters)) continue;
-			size_t found = 1;
+			Archetype* archetype = cache->archetypes[archetypeIndex];
+			const size_t numRows = archetype->GetNumEntities();
+			if (numRows == 0) continue;
 
-			for (int i = 1; i < types.size(); i++)
+			std::array<Column*, sizeof...(Components)> columns{};
+			for (size_t i = 0; i < componentIDs.size(); i++)
 			{
+				const int columnIndex = archetype->FindColumnIndex(componentIDs[i]);
+				columns[i] = columnIndex < 0 ? nullptr : archetype->GetColumn(columnIndex);
+			}
 
-				ComponentID type = types[i];
+			std::array<int, sizeof...(Components)> writtenSlots = { (std::is_const_v<Components> || std::is_empty_v<Components> ? -1 : archetype->FindTypeIndex(GetComponentID<Components>()))... };
+			const ChangeTick changeTick = GetChangeTick();
 
-				if (record.second.archetype->HasComponent(type))
+			const EntityID* entities = archetype->GetEntityList().data();
+			const bool hasDisabledComponents = archetype->HasDisabledComponents();
+			const size_t rowsPerChunk = archetype->GetChunkCapacity();
+			for (size_t chunkStart = 0, chunk = 0; chunkStart < numRows; chunkStart += rowsPerChunk, chunk++)
+			{
+				std::array<std::byte*, sizeof...(Components)> chunks{};
+				for (size_t i = 0; i < columns.size(); i++)
 				{
-					found++;
+					chunks[i] = columns[i] ? columns[i]->GetChunk(chunk) : nullptr;
 				}
-				if (found < 2)
+
+				auto invoke = [&]<size_t... I>(size_t aFirstRow, size_t aLastRow, std::index_sequence<I...>)
 				{
-					break;
+					const size_t offset = aFirstRow - chunkStart;
+					const size_t count = aLastRow - aFirstRow;
+					if constexpr (withEntities)
+					{
+						aFunction(std::span<const EntityID>(entities + aFirstRow, count), GetChunkSpan<Components>(chunks[I], offset, count)...);
+					}
+					else
+					{
+						aFunction(GetChunkSpan<Components>(chunks[I], offset, count)...);
+					}
+
+					for (int slot : writtenSlots)
+					{
+						if (slot < 0) continue;
+						for (size_t row = aFirstRow; row < aLastRow; row++)
+						{
+							archetype->SetChangedTick(slot, row, changeTick);
+						}
+					}
+				};
+
+				const size_t chunkEnd = std::min(numRows, chunkStart + rowsPerChunk);
+				if (!hasDisabledComponents)
+				{
+					invoke(chunkStart, chunkEnd, std::index_sequence_for<Components...>{});
+					continue;
 				}
-			}
-			if (found == types.size() && 0 < record.second.archetype->GetNumEntities())
-			{
 
-				archetypeArray.push_back(record.second.archetype);
+				auto isEnabled = [&](size_t aRow) { return (archetype->GetEnabledRows(cache->denseRequired, aRow >> 6) >> (aRow & 63)) & 1; };
+				for (size_t row = chunkStart; row < chunkEnd;)
+				{
+					while (row < chunkEnd && !isEnabled(row)) row++;
+					const size_t runStart = row;
+					while (row < chunkEnd && isEnabled(row)) row++;
+					if (runStart < row)
+					{
+						invoke(runStart, row, std::index_sequence_for<Components...>{});
+					}
+				}
 			}
 		}
+	}
+
+	template<typename T>
+	inline std::span<T> World::GetChunkSpan(std::byte* aChunk, size_t aOffset, size_t aCount)
+	{
+		if constexpr (std::is_empty<T>::value)
+		{
+			return std::span<T>();
+		}
+		else
+		{
+			return std::span<T>(reinterpret_cast<T*>(aChunk) + aOffset, aCount);
+		}
+	}
+
+	template<typename T>
+	inline T& World::GetEachComponent(std::byte* aChunk, size_t aOffset, EntityID aEntity)
+	{
+		if constexpr (std::is_empty<T>::value)
+		{
+			//Tags have no storage, every row shares one instance
+			static std::remove_cv_t<T> tag{};
+			return tag;
+		}
+		else
+		{
+			if (aChunk) return reinterpret_cast<T*>(aChunk)[aOffset];
+			return *static_cast<T*>(mySparseSets[GetComponentID<T>()].Get(aEntity));
+		}
+	}
+
+	template<typename Term>
+	inline typename QueryTerm<Term>::Argument World::GetEachArgument(std::byte* aChunk, size_t aOffset, EntityID aEntity, const Archetype& aArchetype, size_t aRow)
+	{
+		using T = typename QueryTerm<Term>::Component;
+		if constexpr (std::is_void_v<T>)
+		{
+			return {};
+		}
+		else if constexpr (QueryTerm<Term>::isOptional)
+		{
+			//Optional components are never sparse, a missing column means the archetype doesn't have it
+			if (!aChunk) return { nullptr };
+			if (aArchetype.HasDisabledComponents() && !aArchetype.IsComponentEnabled(GetComponentID<T>(), aRow)) return { nullptr };
+			return { &reinterpret_cast<T*>(aChunk)[aOffset] };
+		}
+		else
+		{
+			return typename QueryTerm<Term>::Argument(GetEachComponent<T>(aChunk, aOffset, aEntity));
+		}
+	}
 
-		if (!archetypeArray.empty())
+	template<typename ...Components, typename ...Filter>
+	inline QueryIterator World::FilteredQuery(std::tuple<Filter...> filters, std::source_location aCallSite)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		const QueryTerms terms = MakeQueryTerms<Components..., Without<Filter...>>();
+
+		QueryCache& cache = GetQueryCache(terms);
+		ChangeTick changedSince = 0;
+		ChangeTick runTick = 0;
+		if (terms.HasChangeFilter())
 		{
-			return QueryIterator(this, archetypeArray);
+			ChangeTick& lastRunTick = cache.GetLastRunTick(aCallSite);
+			changedSince = AdvanceChangeTick(lastRunTick);
+			runTick = lastRunTick;
 		}
-		return QueryIterator();
+		return QueryIterator(this, cache.archetypes, cache.denseRequired, cache.sparseRequired, cache.sparseExcluded, terms.changed, terms.added, changedSince, runTick);
+	}
+
+	template<typename... Components, typename... Filter>
+	inline size_t World::DestroyMatching(std::tuple<Filter...>)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		const QueryTerms terms = MakeQueryTerms<Components..., Without<Filter...>>();
+		assert(!terms.HasChangeFilter(), "DestroyMatching doesn't take change filters");
+
+		const QueryCache& cache = GetQueryCache(terms);
+		const bool hasSparseFilter = cache.sparseRequired.any() || cache.sparseExcluded.any();
+		std::pmr::vector<size_t>& rows = myDestroyRows;
+		size_t numDestroyed = 0;
+		for (Archetype* archetype : cache.archetypes)
+		{
+			const size_t numRows = archetype->GetNumEntities();
+			if (numRows == 0) continue;
+
+			rows.clear();
+			if (!hasSparseFilter && !archetype->HasDisabledComponents())
+			{
+				rows.resize(numRows);
+				std::iota(rows.begin(), rows.end(), size_t(0));
+			}
+			else
+			{
+				//Same rows the query iterator would visit, disabled components and sparse terms filter them
+				const std::pmr::vector<EntityID>& entities = archetype->GetEntityList();
+				ForEachEnabledRow(*archetype, cache.denseRequired, 0, numRows, [&](size_t row)
+				{
+					if (hasSparseFilter && !MatchesSparseComponents(entities[row], cache.sparseRequired, cache.sparseExcluded)) return;
+					rows.push_back(row);
+				});
+				if (rows.empty()) continue;
+			}
+
+			numDestroyed += rows.size();
+			DestroyArchetypeRows(*archetype, rows);
+		}
+		return numDestroyed;
 	}
 
 	template<typename T>
 	inline Entity World::TQuery()
 	{
 		ComponentID id = GetComponentID<T>();
-		if (!myComponentIndex.contains(id)) return Entity();
+		if (IsSparseComponent(id))
+		{
+			const auto& entities = mySparseSets[id].GetEntities();
+			return entities.empty() ? Entity() : Entity(entities.front(), this);
+		}
+		if (myComponentIndex[id].empty()) return Entity();
 
 		const auto& am = myComponentIndex.at(id);
 		for (const auto& record : am)
@@ -521,16 +1250,20 @@ namespace ecs
 	T* World::AddComponent(EntityID e)
 	{
 
-		Record& record = myEntityIndex.at(e);
+		Record& record = myEntityIndex.At(e);
 		assert(!HasComponent<T>(e), "Added already existing component to entity");
 		ComponentID componentID = GetComponentID<T>();
 		Archetype& archetype = *record.archetype;
 		std::lock_guard<std::mutex> lock(myMutex);
+		if (IsSparseComponent(componentID))
+		{
+			RecordEvent(componentID, ObserverType::OnAdd, e);
+			return static_cast<T*>(mySparseSets[componentID].Emplace(e));
+		}
 		Archetype& nextArchetype = AddArchetypeFromSource<T>(archetype);
 		ArchetypeID nextArchetypeID = nextArchetype.GetID();
 
 		assert(archetype.GetID() != nextArchetypeID, "Somehow moving to same archetype");
-		size_t maxCount = nextArchetype.GetMaxCount();
 		MoveEntityFromToArchetype(archetype, e, nextArchetype);
 
 
@@ -539,24 +1272,13 @@ namespace ecs
 			return nullptr;
 		}
 
-		if (maxCount != nextArchetype.GetMaxCount()) //Checking this here because nextArchetype maxCount might change inside MoveEntityFromToArchetype
-		{
-			ArchetypeMap& archetypeMap = myComponentIndex.at(componentID);
-			size_t columnID = archetypeMap.at(nextArchetypeID).columnIndex;
-			nextArchetype.GetColumn(columnID)->Resize(nextArchetype.GetColumn(columnID)->GetCapacity() * 2);
-		}
 		ArchetypeMap& archetypeMap = myComponentIndex.at(componentID);
 		ArchetypeRecord& archetypeRecord = archetypeMap.at(nextArchetypeID);
 
 
-		if (!nextArchetype.HasComponent(GetComponentID<DontDestroyOnLoad>()) && !myClearOnLoadIndex.contains(nextArchetypeID))
-		{
-			myClearOnLoadArchetypeList.emplace_back(&nextArchetype.GetType());
-			size_t index = myClearOnLoadArchetypeList.size();
-			myClearOnLoadIndex.emplace(nextArchetypeID, index);
-		}
+		TrackClearOnLoad(nextArchetype);
 
-		assert(nextArchetype.GetColumn(archetypeRecord.columnIndex)->GetTypeInfo().typeID == typeid(T), "This component is not the right type, imminent pagefault.");
+		assert(nextArchetype.GetColumn(archetypeRecord.columnIndex)->GetTypeInfo().typeID == componentID, "This component is not the right type, imminent pagefault.");
 
 		void* targetComponent = nextArchetype.GetColumn(archetypeRecord.columnIndex)->GetComponent(record.row);
 		nextArchetype.GetColumn(archetypeRecord.columnIndex)->ChangeMemoryUsed(1);
@@ -565,10 +1287,173 @@ namespace ecs
 		return newComponent;
 	}
 
+	template<typename... Components>
+	inline std::tuple<Components*...> World::AddComponents(EntityID e)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		Record& record = myEntityIndex.At(e);
+		Archetype& archetype = *record.archetype;
+
+		const ComponentID componentIDs[] = { GetComponentID<Components>()... };
+		bool isNew[sizeof...(Components)] = {};
+		Type newType = archetype.GetType();
+		for (size_t i = 0; i < sizeof...(Components); i++)
+		{
+			const ComponentID componentID = componentIDs[i];
+			if (IsSparseComponent(componentID))
+			{
+				isNew[i] = !mySparseSets[componentID].Contains(e);
+				continue;
+			}
+			if (archetype.HasComponent(componentID) || std::find(newType.begin(), newType.end(), componentID) != newType.end()) continue;
+
+			newType.emplace_back(componentID);
+			isNew[i] = true;
+		}
+		std::sort(newType.begin(), newType.end());
+
+		Archetype& nextArchetype = GetOrCreateArchetype(newType);
+		if (&nextArchetype != &archetype)
+		{
+			MoveEntityFromToArchetype(archetype, e, nextArchetype);
+			TrackClearOnLoad(nextArchetype);
+		}
+
+		//Only the components that weren't there before get constructed, the rest were moved over with the entity
+		size_t index = 0;
+		auto construct = [&]<typename T>() -> T*
+		{
+			const ComponentID componentID = componentIDs[index];
+			const bool constructNew = isNew[index++];
+			if (IsSparseComponent(componentID))
+			{
+				if (!constructNew) return static_cast<T*>(mySparseSets[componentID].Get(e));
+				RecordEvent(componentID, ObserverType::OnAdd, e);
+				return static_cast<T*>(mySparseSets[componentID].Emplace(e));
+			}
+			if constexpr (std::is_empty<T>::value)
+			{
+				return nullptr;
+			}
+			else
+			{
+				const int columnIndex = nextArchetype.FindColumnIndex(componentID);
+				void* component = nextArchetype.GetColumn(columnIndex)->GetComponent(record.row);
+				if (!constructNew) return static_cast<T*>(component);
+
+				nextArchetype.GetColumn(columnIndex)->ChangeMemoryUsed(1);
+				return new (component) T();
+			}
+		};
+		return std::tuple<Components*...>{ construct.template operator()<Components>()... };
+	}
+
+	template<typename... Components>
+	inline std::span<const EntityID> World::CreateBatch(size_t aCount)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		Type type;
+		for (ComponentID componentID : { GetComponentID<Components>()... })
+		{
+			if (!IsSparseComponent(componentID)) type.push_back(componentID);
+		}
+		std::sort(type.begin(), type.end());
+		type.erase(std::unique(type.begin(), type.end()), type.end());
+
+		Archetype& archetype = GetOrCreateArchetype(type);
+		const size_t firstRow = archetype.GetNumEntities();
+		archetype.ReserveRows(firstRow + aCount);
+
+		myCreatedBatch.clear();
+		myCreatedBatch.reserve(aCount);
+		AddBatchEntities(archetype, firstRow, aCount);
+
+		//One column at a time so construction walks each chunk slice front to back
+		auto construct = [&]<typename T>()
+		{
+			const ComponentID componentID = GetComponentID<T>();
+			if (IsSparseComponent(componentID))
+			{
+				for (EntityID entity : myCreatedBatch)
+				{
+					mySparseSets[componentID].Emplace(entity);
+					RecordEvent(componentID, ObserverType::OnAdd, entity);
+				}
+			}
+			else if constexpr (!std::is_empty<T>::value)
+			{
+				Column* column = archetype.GetColumn(archetype.FindColumnIndex(componentID));
+				for (size_t row = firstRow; row < firstRow + aCount; row++)
+				{
+					new (column->GetComponent(row)) T();
+				}
+				column->ChangeMemoryUsed(static_cast<int>(aCount));
+			}
+		};
+		(construct.template operator()<Components>(), ...);
+		archetype.SetRowsAdded(firstRow, firstRow + aCount, GetChangeTick());
+		RecordRowEvents(archetype, firstRow, firstRow + aCount, ObserverType::OnAdd);
+
+		TrackClearOnLoad(archetype);
+		return myCreatedBatch;
+	}
+
+	template<typename... Components>
+	inline void World::Reserve(size_t aCount)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		Type type;
+		for (ComponentID componentID : { GetComponentID<Components>()... })
+		{
+			if (!IsSparseComponent(componentID)) type.push_back(componentID);
+		}
+		std::sort(type.begin(), type.end());
+		type.erase(std::unique(type.begin(), type.end()), type.end());
+
+		Archetype& archetype = GetOrCreateArchetype(type);
+		archetype.ReserveRows(archetype.GetNumEntities() + aCount);
+
+		std::lock_guard<std::mutex> generationLock(myEntityGenerationMutex);
+		myEntityIndex.Reserve(aCount);
+	}
+
+	template<typename... Components>
+	inline void World::RemoveComponents(EntityID e)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		Record& record = myEntityIndex.At(e);
+		Archetype& archetype = *record.archetype;
+
+		ComponentMask removed;
+		for (ComponentID componentID : { GetComponentID<Components>()... })
+		{
+			if (IsSparseComponent(componentID))
+			{
+				if (mySparseSets[componentID].Erase(e)) RecordEvent(componentID, ObserverType::OnRemove, e);
+				continue;
+			}
+			removed.set(componentID);
+		}
+
+		Type newType = archetype.GetType();
+		newType.erase(std::remove_if(newType.begin(), newType.end(), [&](ComponentID aComponentID) { return removed.test(aComponentID); }), newType.end());
+		if (newType.size() == archetype.GetNumTypes()) return;
+
+		Archetype& nextArchetype = GetOrCreateArchetype(newType);
+		MoveEntityFromToArchetype(archetype, e, nextArchetype);
+		TrackClearOnLoad(nextArchetype);
+	}
+
 	template <typename T>
 	void World::RemoveComponent(EntityID e)
 	{
-		auto& record = myEntityIndex.at(e);
+		if (IsSparseComponent(GetComponentID<T>()))
+		{
+			if (mySparseSets[GetComponentID<T>()].Erase(e)) RecordEvent(GetComponentID<T>(), ObserverType::OnRemove, e);
+			return;
+		}
+
+		auto& record = myEntityIndex.At(e);
 		if (!record.archetype || !record.archetype->Contains(std::tuple<T>())) return;
 
 		ArchetypeEdge& edges = record.archetype->GetOrAddEdge(GetComponentID<T>());
@@ -578,12 +1463,7 @@ namespace ecs
 
 
 
-			if (!edges.removeArchetypes->HasComponent(GetComponentID<DontDestroyOnLoad>()) && !myClearOnLoadIndex.contains(edges.removeArchetypes->GetID()))
-			{
-				myClearOnLoadArchetypeList.emplace_back(&edges.removeArchetypes->GetType());
-				size_t index = myClearOnLoadArchetypeList.size();
-				myClearOnLoadIndex.emplace(edges.removeArchetypes->GetID(), index);
-			}
+			TrackClearOnLoad(*edges.removeArchetypes);
 		}
 		else
 		{
@@ -604,16 +1484,13 @@ namespace ecs
 			if (myArchetypeIndex.contains(newType))
 			{
 				auto& newArchetype = myArchetypeIndex.at(newType);
+				edges.removeArchetypes = &newArchetype;
+				newArchetype.GetOrAddEdge(GetComponentID<T>()).addArchetypes = record.archetype;
 				MoveEntityFromToArchetype(*record.archetype, e, newArchetype);
 
 
 
-				if (!newArchetype.HasComponent(GetComponentID<DontDestroyOnLoad>()) && !myClearOnLoadIndex.contains(newArchetype.GetID()))
-				{
-					myClearOnLoadArchetypeList.emplace_back(&newArchetype.GetType());
-					size_t index = myClearOnLoadArchetypeList.size();
-					myClearOnLoadIndex.emplace(newArchetype.GetID(), index);
-				}
+				TrackClearOnLoad(newArchetype);
 			}
 			else
 			{
@@ -624,6 +1501,7 @@ namespace ecs
 
 				newArchetype.SetID(GenerateArchetypeID());
 				newArchetype.SetType(newType);
+				RegisterArchetype(newArchetype);
 
 				size_t numComponents{ 0 };
 				bool isTag = false;
@@ -632,7 +1510,6 @@ namespace ecs
 				ArchetypeID sourceArchetypeID = record.archetype->GetID();
 				for (int i = 0; i < newType.size(); ++i)
 				{
-					newArchetype.AddComponentIDToTypeSet(newType[i]);
 					ArchetypeMap& am = myComponentIndex[newType[i]];
 					am[sourceArchetypeID].columnIndex < 0 ? isTag = true : isTag = false;
 
@@ -653,16 +1530,9 @@ namespace ecs
 				}
 
 				//Copying over component structure from old archetype to new archetype, no data is copied at this point.
-				//Only copying meta data for component structure 
-				size_t maxCount = 2;
-				newArchetype.ReserveComponentsSize(record.archetype->GetNumComponents());
-				newArchetype.SetMaxCount(maxCount);
-
-				for (int i = 0; i < newArchetype.GetComponentCapacity(); i++)
-				{
-					newArchetype.AddEmptyComp();
-
-				}
+				//Only copying meta data for component structure, chunks are allocated once the first entity moves in.
+				newArchetype.ReserveComponentsSize(numComponents);
+				newArchetype.ResizeComponents(numComponents);
 
 				for (int i = 0; i < record.archetype->GetNumTypes(); i++)
 				{
@@ -674,12 +1544,7 @@ namespace ecs
 					if (sourceColumnIndex == -1 || targetColumnIndex == -1) continue; //Its a tag
 
 					newArchetype.GetColumn(targetColumnIndex)->AssignTypeInfo(record.archetype->GetColumn(sourceColumnIndex)->GetTypeInfo());
-
-					size_t elementSize = newArchetype.GetColumn(targetColumnIndex)->GetElementSize();
-					newArchetype.GetColumn(targetColumnIndex)->Reset(new std::byte[elementSize * maxCount]);
-					newArchetype.GetColumn(targetColumnIndex)->SetCapacity(maxCount * elementSize);
 				}
-				InvalidateCachedQueryFromMove(sourceArchetype, &newArchetype);
 				ArchetypeEdge& edge = record.archetype->GetEdge(componentID);
 				edge.removeArchetypes = &myArchetypeIndex[newType];
 
@@ -687,12 +1552,7 @@ namespace ecs
 				newArchetype.GetOrAddEdge(componentID).addArchetypes = record.archetype;
 
 
-				if (!newArchetype.HasComponent(GetComponentID<DontDestroyOnLoad>()) && !myClearOnLoadIndex.contains(newArchetype.GetID()))
-				{
-					myClearOnLoadArchetypeList.emplace_back(&newArchetype.GetType());
-					size_t index = myClearOnLoadArchetypeList.size();
-					myClearOnLoadIndex.emplace(newArchetype.GetID(), index);
-				}
+				TrackClearOnLoad(newArchetype);
 
 				MoveEntityFromToArchetype(*record.archetype, e, newArchetype);
 			}
@@ -706,15 +1566,14 @@ namespace ecs
 	template<typename T, typename ...args>
 	inline void World::Set(EntityID aEntity, args&&... aArgumentList)
 	{
-		ArchetypeMap& am = myComponentIndex.at(GetComponentID<T>());
-		const auto index = myEntityIndex.at(aEntity).row;
-		const auto archetype = myEntityIndex.at(aEntity).archetype;
-		const auto archetypeID = myEntityIndex.at(aEntity).archetype->GetID();;
-		const auto columnIndex = am.at(archetypeID).columnIndex;
-		const auto& column = archetype->components.at(columnIndex);
+		const ComponentID componentID = GetComponentID<T>();
+		const Record& record = myEntityIndex.At(aEntity);
+		T* t = static_cast<T*>(IsSparseComponent(componentID) ? mySparseSets[componentID].Get(aEntity) : record.archetype->GetComponent(componentID, record.row));
+		assert(t, "Entity doesn't have the component");
 
 		InvokeObserverCallbacks<T>(aEntity, ecs::ObserverType::OnSet);
-		T* t = static_cast<T*>(column[index]);
+		RecordEvent(componentID, ObserverType::OnSet, aEntity);
+		MarkChanged(*record.archetype, componentID, record.row);
 		*t = T(std::forward<args>(aArgumentList)...);
 	}
 
@@ -726,9 +1585,51 @@ namespace ecs
 		observerLists[aType].emplace_back(std::forward<Func>(aFunc));
 	}
 
+	template<typename T, typename Func>
+	inline void World::Observe(ObserverType aType, Func&& aFunc)
+	{
+		static_assert(std::is_invocable_v<Func&, std::span<const EntityID>>, "Observe expects a function taking std::span<const EntityID>");
+		assert(!myIsDispatchingEvents, "Can't subscribe from inside a subscriber");
+
+		std::lock_guard<std::mutex> lock(myEventMutex);
+		const ComponentID componentID = GetComponentID<T>();
+		const size_t index = componentID * ECS_OBSERVER_TYPE_COUNT + static_cast<size_t>(aType);
+		if (myEventStreams.size() <= index)
+		{
+			myEventStreams.resize((componentID + 1) * ECS_OBSERVER_TYPE_COUNT);
+		}
+		myEventStreams[index].Subscribe(EventCallback(std::forward<Func>(aFunc)));
+		myObservedComponents[static_cast<size_t>(aType)].set(componentID);
+	}
+
+	inline void World::RecordEvent(ComponentID aComponentID, ObserverType aType, EntityID aEntity)
+	{
+		if (!myObservedComponents[static_cast<size_t>(aType)].test(aComponentID)) return;
+
+		std::lock_guard<std::mutex> lock(myEventMutex);
+		myEventStreams[aComponentID * ECS_OBSERVER_TYPE_COUNT + static_cast<size_t>(aType)].Record(aEntity);
+	}
+
 	template<typename T>
 	inline void World::EnableComponent(ecs::EntityID aEntityID, bool isEnabled)
 	{
+		const ComponentID componentID = GetComponentID<T>();
+		assert(!IsSparseComponent(componentID), "Sparse components can't be disabled, remove them instead");
+
+		Record* record = myEntityIndex.Find(aEntityID);
+		if (!record || !record->archetype->HasComponent(componentID)) return;
+		record->archetype->SetComponentEnabled(componentID, record->row, isEnabled);
+	}
+
+	template<typename T>
+	inline bool World::IsComponentEnabled(ecs::EntityID aEntityID) const
+	{
+		const ComponentID componentID = GetComponentID<T>();
+		if (IsSparseComponent(componentID)) return mySparseSets[componentID].Contains(aEntityID);
+		if (!myEntityIndex.Contains(aEntityID)) return false;
+
+		const Record& record = myEntityIndex.At(aEntityID);
+		return record.archetype->IsComponentEnabled(componentID, record.row);
 	}
 
 	template <typename T>
@@ -736,6 +1637,11 @@ namespace ecs
 	{
 		ComponentID componentID = GetComponentID<T>();
 
+		ArchetypeEdge& sourceEdge = aArchetypeSource.GetOrAddEdge(componentID);
+		if (sourceEdge.addArchetypes)
+		{
+			return *sourceEdge.addArchetypes;
+		}
 
 		Type newType = aArchetypeSource.GetType();
 		newType.emplace_back(componentID);
@@ -744,12 +1650,15 @@ namespace ecs
 		auto it = myArchetypeIndex.find(newType);
 		if (it != myArchetypeIndex.end())
 		{
+			sourceEdge.addArchetypes = &it->second;
+			it->second.GetOrAddEdge(componentID).removeArchetypes = &aArchetypeSource;
 			return it->second;
 		}
 
 		myArchetypeIndex[newType] = Archetype();
 		myArchetypeIndex[newType].SetID(GenerateArchetypeID());
 		myArchetypeIndex[newType].SetType(newType);
+		RegisterArchetype(myArchetypeIndex[newType]);
 		auto& newArchetype = myArchetypeIndex[newType];
 		ArchetypeID newArchetypeID = newArchetype.GetID();
 		size_t numComponents{ 0 };
@@ -758,14 +1667,13 @@ namespace ecs
 		for (int i = 0; i < newType.size(); ++i)
 		{
 
-			newArchetype.AddComponentIDToTypeSet(newType[i]);
 			ArchetypeMap& am = myComponentIndex[newType[i]];
 
 			if (aArchetypeSource.HasComponent(newType[i]))
 			{
 				isTag = am[aArchetypeSource.GetID()].columnIndex < 0 ? true : false;
 			}
-			if (isTag || (newType[i] == typeid(T) && std::is_empty<T>()))
+			if (isTag || (newType[i] == componentID && std::is_empty<T>()))
 			{
 				am[newArchetypeID].columnIndex = -1;
 				am[newArchetypeID].archetype = &myArchetypeIndex[newType];
@@ -782,9 +1690,8 @@ namespace ecs
 		}
 
 		//Copying over component structure from old archetype to new archetype, no data is copied at this point.
-		//Only copying meta data for component structure 
+		//Only copying meta data for component structure, chunks are allocated once the first entity moves in.
 		newArchetype.ReserveComponentsSize(numComponents);
-		newArchetype.SetMaxCount(2);
 		newArchetype.ResizeComponents(numComponents);
 
 
@@ -800,11 +1707,6 @@ namespace ecs
 				if (sourceColumnIndex == -1 || targetColumnIndex == -1) continue; //Its a tag.
 
 				newArchetype.GetColumn(targetColumnIndex)->AssignTypeInfo(aArchetypeSource.GetColumn(sourceColumnIndex)->GetTypeInfo());
-
-				size_t elementSize = newArchetype.GetColumn(targetColumnIndex)->GetElementSize();
-				size_t maxCount = newArchetype.GetMaxCount();
-				newArchetype.GetColumn(targetColumnIndex)->Reset(new std::byte[elementSize * maxCount]);
-				newArchetype.GetColumn(targetColumnIndex)->SetCapacity(elementSize * maxCount);
 			}
 		}
 
@@ -816,11 +1718,7 @@ namespace ecs
 			int targetColumnIndex = newArchetypeMap.at(newArchetypeID).columnIndex;
 
 			Column* col = newArchetype.GetColumn(targetColumnIndex);
-			col->AssignTypeInfo(RegisterComponent<T>());
-			size_t maxCount = myArchetypeIndex[newType].GetMaxCount();
-			size_t elementSize = col->GetElementSize();
-			col->Reset(new std::byte[elementSize * maxCount]);
-			col->SetCapacity(elementSize * maxCount);
+			col->AssignTypeInfo(ComponentRegistry::GetTypeInfo(componentID));
 		}
 
 		ArchetypeEdge& edge = aArchetypeSource.AddEdge(componentID);
@@ -839,10 +1737,4 @@ namespace ecs
 		return myArchetypeIndex[newType];
 	}
 
-	template<typename T>
-	ComponentID GetComponentID()
-	{
-		return typeid(T);
-	}
-
 }